@@ -89,6 +89,10 @@ class forward_list {
   inner_alloc_type m_inner_alloc;
   node_pointer head; // Not requested from the allocator.
   node_pointer create_node(const T& data);
+  template<class InputIt>
+  void push_front(InputIt first, InputIt last, std::input_iterator_tag);
+  template<class InputIt>
+  void push_front(InputIt first, InputIt last, std::forward_iterator_tag);
   public:
   forward_list(const Allocator& alloc = Allocator()) noexcept;
   template<class InputIt>
@@ -119,13 +123,19 @@ class forward_list {
   const_iterator cend() const noexcept {return const_iterator(head);}
   ~forward_list()
   {
+    // See ~set.
+    if (std::is_trivially_destructible<T>::value
+        && inner_alloct_type::drops_nodes(m_inner_alloc))
+      return;
     clear();
     inner_alloct_type::deallocate_node(m_inner_alloc, head);
   }
   bool empty() const {return head->next == head;}
   node_pointer create_node(T&& data);
-  void push_front(T&& data);
-  void push_front(const T& data);
+  // The new element, or end() when a fixed size allocator has run
+  // out and the element is left out.
+  iterator push_front(T&& data);
+  iterator push_front(const T& data);
   void safe_construct(node_pointer p, const T& key);
   void safe_construct(node_pointer p, T&& key);
   void remove_if(T value);
@@ -145,8 +155,10 @@ template <typename T, typename Allocator>
 typename forward_list<T, Allocator>::node_pointer
 forward_list<T, Allocator>::create_node(const T& data)
 {
+  // Null when a fixed size allocator is exhausted.
   auto q = inner_alloct_type::allocate_node(m_inner_alloc);
-  safe_construct(q, data);
+  if (q)
+    safe_construct(q, data);
   return q;
 }
 
@@ -154,8 +166,10 @@ template <typename T, typename Allocator>
 typename forward_list<T, Allocator>::node_pointer
 forward_list<T, Allocator>::create_node(T&& data)
 {
+  // Null when a fixed size allocator is exhausted.
   auto q = inner_alloct_type::allocate_node(m_inner_alloc);
-  safe_construct(q, std::forward<T>(data));
+  if (q)
+    safe_construct(q, std::forward<T>(data));
   return q;
 }
 
@@ -177,23 +191,64 @@ forward_list<T, Allocator>::forward_list( InputIt begin
 , head(create_node(T()))
 {
   head->next = head;
-  std::copy(begin, end, std::front_inserter(*this));
+  using category =
+    typename std::iterator_traits<InputIt>::iterator_category;
+  push_front(begin, end, category());
+}
+
+template <class T, class Allocator>
+template<class InputIt>
+void forward_list<T, Allocator>::push_front( InputIt first
+                                           , InputIt last
+                                           , std::input_iterator_tag)
+{
+  std::copy(first, last, std::front_inserter(*this));
+}
+
+template <class T, class Allocator>
+template<class InputIt>
+void forward_list<T, Allocator>::push_front( InputIt first
+                                           , InputIt last
+                                           , std::forward_iterator_tag)
+{
+  // Nodes are taken from the allocator in runs of adjacent nodes.
+  // Elements past what a fixed size allocator can hold are left
+  // out, see set::assign_sorted.
+  auto n = static_cast<std::size_t>(std::distance(first, last));
+  while (n != 0) {
+    auto run = inner_alloct_type::allocate_nodes(m_inner_alloc, n);
+    if (run.first == run.second || !run.first)
+      break;
+    for (; run.first != run.second; ++run.first, ++first, --n) {
+      auto q = run.first;
+      try {
+        inner_alloct_type::construct(m_inner_alloc,
+          std::addressof(q->info), *first);
+      } catch (...) {
+        node_chain<inner_alloc_type> chain(m_inner_alloc);
+        for (; run.first != run.second; ++run.first)
+          chain.push(run.first);
+        chain.release();
+        throw;
+      }
+      q->next = head->next;
+      head->next = q;
+    }
+  }
 }
 
 template <typename T, typename Allocator>
-void forward_list<T, Allocator>::push_front(T&& data)
+typename forward_list<T, Allocator>::iterator
+forward_list<T, Allocator>::push_front(T&& data)
 {
-  auto q = create_node(std::forward<T>(data));
-  q->next = head->next;
-  head->next = q;
+  return insert_after(const_iterator(head), std::forward<T>(data));
 }
 
 template <typename T, typename Allocator>
-void forward_list<T, Allocator>::push_front(const T& data)
+typename forward_list<T, Allocator>::iterator
+forward_list<T, Allocator>::push_front(const T& data)
 {
-  auto q = create_node(data);
-  q->next = head->next;
-  head->next = q;
+  return insert_after(const_iterator(head), data);
 }
 
 template <typename T, typename Allocator>
@@ -284,6 +339,8 @@ forward_list<T, Allocator>::insert_after(
   auto q = pos.get_internal_ptr();
   auto p = q->next;
   auto u = create_node(K);
+  if (!u)
+    return end();
   q->next = u;
   u->next = p;
   return iterator(u);
@@ -298,6 +355,8 @@ forward_list<T, Allocator>::insert_after(
   auto q = pos.get_internal_ptr();
   auto p = q->next;
   auto u = create_node(std::forward<T>(K));
+  if (!u)
+    return end();
   q->next = u;
   u->next = p;
   return iterator(u);
@@ -348,13 +407,16 @@ void forward_list<T, Allocator>::insertion_sort(Compare comp)
 template <typename T, typename Allocator>
 void forward_list<T, Allocator>::clear()
 {
+  // Nodes are released at once at the end.
+  node_chain<inner_alloc_type> chain(m_inner_alloc);
   while (head->next != head) {
     auto p = head;
     p = head->next;
     head->next = p->next;
     inner_alloct_type::destroy(m_inner_alloc, &p->info);
-    inner_alloct_type::deallocate_node(m_inner_alloc, p);
+    chain.push(p);
   }
+  chain.release();
 }
 
 }
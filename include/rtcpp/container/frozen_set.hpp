@@ -0,0 +1,229 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <functional>
+
+#include <rtcpp/memory/bit_tree.hpp>
+
+#include "set.hpp"
+
+/*
+  An immutable copy of a set for read-heavy phases. The keys are kept
+  in one array in Eytzinger order, the order of a breadth first walk
+  of a complete binary search tree: the children of the key at
+  position k are at 2k and 2k + 1, counting from one. A search only
+  moves down that implicit tree, without branches, and prefetches the
+  keys a few levels below. T must be default constructible.
+*/
+
+namespace rt {
+
+// Moves in the implicit tree of n keys, positions counting from one,
+// zero being past the end.
+struct eytzinger {
+  // The first position in order of the subtree of k, I = 0, or the
+  // last, I = 1.
+  template <std::size_t I>
+  static std::size_t extreme(std::size_t k, std::size_t n) noexcept
+  {
+    while (2 * k + I <= n)
+      k = 2 * k + I;
+    return k;
+  }
+
+  // The next position in order, I = 1, or the previous, I = 0.
+  template <std::size_t I>
+  static std::size_t inorder(std::size_t k, std::size_t n) noexcept
+  {
+    if (2 * k + I <= n)
+      return extreme<1 - I>(2 * k + I, n);
+    // Up while k is the child I of its parent.
+    while ((k & 1) == I)
+      k >>= 1;
+    return k >> 1;
+  }
+};
+
+template <class T, class Ptr>
+class frozen_set_iterator :
+  public std::iterator<std::bidirectional_iterator_tag, const T> {
+  public:
+  Ptr m_keys;
+  std::size_t m_n;
+  std::size_t m_k;
+  frozen_set_iterator() noexcept : m_keys(), m_n(0), m_k(0) {}
+  frozen_set_iterator(Ptr keys, std::size_t n, std::size_t k) noexcept
+  : m_keys(keys), m_n(n), m_k(k) {}
+
+  auto& operator++() noexcept
+  { m_k = eytzinger::inorder<1>(m_k, m_n); return *this; }
+
+  auto operator++(int) noexcept
+  { auto tmp(*this); operator++(); return tmp; }
+
+  // From the end to the last key.
+  auto& operator--() noexcept
+  {
+    if (m_k == 0)
+      m_k = eytzinger::extreme<1>(1, m_n);
+    else
+      m_k = eytzinger::inorder<0>(m_k, m_n);
+    return *this;
+  }
+
+  auto operator--(int) noexcept
+  { auto tmp(*this); operator--(); return tmp; }
+
+  const T& operator*() const noexcept {return m_keys[m_k - 1];}
+
+  friend
+  auto operator==( const frozen_set_iterator& rhs
+                 , const frozen_set_iterator& lhs) noexcept
+  { return lhs.m_k == rhs.m_k; }
+
+  friend
+  auto operator!=( const frozen_set_iterator& rhs
+                 , const frozen_set_iterator& lhs) noexcept
+  { return !(lhs == rhs); }
+};
+
+template < class T
+         , class Compare = std::less<T>
+         , class Allocator = std::allocator<T>>
+class frozen_set {
+  public:
+  using key_type = T;
+  using value_type = T;
+  using size_type = std::size_t;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using const_reference = const value_type&;
+  using allocator_type = Allocator;
+  using const_pointer = const value_type*;
+  using difference_type = std::ptrdiff_t;
+  using const_iterator = frozen_set_iterator<T, const_pointer>;
+  using iterator = const_iterator;
+  using const_reverse_iterator =
+    std::reverse_iterator<const_iterator>;
+
+  private:
+  // Keys below the one looked at that share a cache line.
+  static constexpr std::size_t line_keys =
+    sizeof (T) < 64 ? 64 / sizeof (T) : 1;
+
+  std::vector<T, Allocator> m_keys;
+  Compare m_comp;
+
+  public:
+  // From a sorted range of keys with no equivalent ones, in O(n).
+  template <class ForwardIt>
+  frozen_set( ForwardIt first, ForwardIt last
+            , const Compare& comp = Compare()
+            , const Allocator& alloc = Allocator())
+  : m_keys( static_cast<size_type>(std::distance(first, last))
+          , T(), alloc)
+  , m_comp(comp)
+  {
+    const auto n = m_keys.size();
+    if (n == 0)
+      return;
+    for (auto k = eytzinger::extreme<0>(1, n); k != 0; ++first) {
+      m_keys[k - 1] = *first;
+      k = eytzinger::inorder<1>(k, n);
+    }
+  }
+
+  // Freezes s, whose keys are walked in order.
+  template <class A, class B>
+  explicit frozen_set( const set<T, Compare, A, B>& s
+                     , const Allocator& alloc = Allocator())
+  : frozen_set(std::begin(s), std::end(s), s.key_comp(), alloc) {}
+
+  const_iterator begin() const noexcept
+  {
+    const auto n = size();
+    return make_iterator(n == 0 ? 0 : eytzinger::extreme<0>(1, n));
+  }
+  const_iterator end() const noexcept { return make_iterator(0); }
+  auto rbegin() const noexcept {return const_reverse_iterator(end());}
+  auto rend() const noexcept {return const_reverse_iterator(begin());}
+  auto key_comp() const noexcept {return m_comp;}
+  auto value_comp() const noexcept {return m_comp;}
+  size_type size() const noexcept {return m_keys.size();}
+  bool empty() const noexcept {return m_keys.empty();}
+  auto get_allocator() const noexcept {return m_keys.get_allocator();}
+
+  // The first key not less than key.
+  template <class K>
+  const_iterator lower_bound(const K& key) const noexcept
+  {
+    return make_iterator(descend(
+      [&](const T& a) { return m_comp(a, key); }));
+  }
+
+  // The first key greater than key.
+  template <class K>
+  const_iterator upper_bound(const K& key) const noexcept
+  {
+    return make_iterator(descend(
+      [&](const T& a) { return !m_comp(key, a); }));
+  }
+
+  template <class K>
+  const_iterator find(const K& key) const noexcept
+  {
+    const auto iter = lower_bound(key);
+    if (iter == end() || m_comp(key, *iter))
+      return end();
+    return iter;
+  }
+
+  template <class K>
+  size_type count(const K& key) const noexcept
+  { return find(key) == end() ? 0 : 1; }
+
+  private:
+  const_iterator make_iterator(size_type k) const noexcept
+  { return const_iterator(m_keys.data(), size(), k); }
+
+  // Goes down the implicit tree to the right of the keys for which
+  // right holds, and returns the position of the first key where it
+  // does not, zero if there is none.
+  template <class F>
+  size_type descend(F right) const noexcept
+  {
+    const auto n = size();
+    const auto keys = m_keys.data();
+    size_type k = 1;
+    while (k <= n) {
+#if defined(__GNUC__)
+      // Integer arithmetic, as the address may be past the array.
+      const auto addr = reinterpret_cast<std::uintptr_t>(keys)
+                      + (line_keys * k - 1) * sizeof (T);
+      __builtin_prefetch(reinterpret_cast<const void*>(addr));
+#endif
+      k = 2 * k + right(keys[k - 1]);
+    }
+    // Drops the right turns taken after the last left one.
+    const auto turns = count_trailing_zeros(~std::uint64_t(k));
+    return k >> (turns + 1);
+  }
+};
+
+template<typename Key, typename Compare, typename Alloc>
+bool operator==( const frozen_set<Key, Compare, Alloc>& lhs
+               , const frozen_set<Key, Compare, Alloc>& rhs) noexcept
+{
+  return lhs.size() == rhs.size()
+    && std::equal(std::begin(lhs), std::end(lhs), std::begin(rhs));
+}
+
+template<typename Key, typename Compare, typename Alloc>
+bool operator!=( const frozen_set<Key, Compare, Alloc>& lhs
+               , const frozen_set<Key, Compare, Alloc>& rhs) noexcept
+{ return !(lhs == rhs); }
+
+}
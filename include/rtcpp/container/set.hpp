@@ -1,5 +1,8 @@
+#pragma once
+
 #include <memory>
 #include <limits>
+#include <vector>
 #include <utility>
 #include <iterator>
 #include <algorithm>
@@ -15,7 +18,9 @@
   Implements a std::set as a threaded binary search tree. That means
   it does not guarantee logarithmic search time. It is however often
   faster than a balanced implementation as a degenerate tree is very
-  rare and there is no balancing overhead.
+  rare and there is no balancing overhead. Inputs that are already
+  sorted do degenerate it though, the Balance parameter tbst::avl
+  keeps the tree balanced in that case, see tbst.hpp.
 */
 
 namespace rt {
@@ -94,7 +99,8 @@ class const_bst_iterator :
 
 template < class T
          , class Compare = std::less<T>
-         , class Allocator = std::allocator<T>>
+         , class Allocator = std::allocator<T>
+         , class Balance = tbst::unbalanced>
 class set {
   public:
   using key_type = T;
@@ -114,7 +120,9 @@ class set {
   using void_pointer = typename alloc_traits_type::void_pointer;
   using link_type = typename alloc_traits_type::link_type;
   public:
-  using node_type = tbst::node<value_type, link_type>;
+  using node_type =
+    tbst::node< value_type, link_type
+              , std::is_base_of<tbst::ranked, Balance>::value>;
   private:
   using inner_alloc_type =
     typename alloc_traits_type::template rebind_alloc<node_type>;
@@ -129,9 +137,13 @@ class set {
   using const_reverse_iterator =
     std::reverse_iterator<const_iterator>;
 private:
+  // Neighbours of a hint looked at before inserting from the root.
+  static constexpr int hint_reach = 4;
+
   mutable inner_alloc_type m_inner_alloc;
   node_pointer m_head;
   Compare m_comp;
+  size_type m_size = 0;
 
   auto get_node() const
   { return inner_alloc_traits_type::allocate_node(m_inner_alloc); }
@@ -148,6 +160,65 @@ private:
     }
   }
 
+  // A node getter that copies key in the nodes it gets from get.
+  template <class F>
+  auto copying(const value_type& key, F& get) const
+  {
+    return [this, &key, &get]()
+    {
+      auto q = get();
+      if (q)
+        safe_construct(q, key);
+      return q;
+    };
+  }
+
+  template <class... Args>
+  node_pointer make_node(Args&&... args)
+  {
+    auto q = get_node();
+    if (!q)
+      return q;
+    try {
+      inner_alloc_traits_type::construct( m_inner_alloc
+                                        , std::addressof(q->key)
+                                        , std::forward<Args>(args)...);
+    } catch (...) {
+      release_node(q);
+      throw;
+    }
+    return q;
+  }
+
+  // Counts q if it was inserted, as r tells, or releases it.
+  std::pair<iterator, bool>
+  insert_made(node_pointer q, std::pair<iterator, bool> r) noexcept
+  {
+    if (r.second) {
+      ++m_size;
+    } else {
+      inner_alloc_traits_type::destroy(m_inner_alloc, &q->key);
+      release_node(q);
+    }
+    return r;
+  }
+
+  // The node of a const_iterator of the set.
+  node_pointer to_node(const_node_pointer p) const noexcept
+  { return to_node(p, std::is_pointer<node_pointer>()); }
+
+  node_pointer
+  to_node(const_node_pointer p, std::true_type) const noexcept
+  { return const_cast<node_pointer>(p); }
+
+  node_pointer
+  to_node(const_node_pointer p, std::false_type) const noexcept
+  {
+    auto q = m_head;
+    q = static_cast<link_type>(p);
+    return q;
+  }
+
 public:
   set(const Compare& comp, const Allocator& alloc = Allocator())
   : m_inner_alloc(alloc_traits_type::select_on_container_copy_construction(alloc))
@@ -174,6 +245,7 @@ public:
     m_head->template set_link_null<0>();
     clear();
     tbst::copy(rhs.m_head, this->m_head, [this](){return get_node();});
+    m_size = rhs.m_size;
   }
 
   template <typename InputIt>
@@ -187,7 +259,9 @@ public:
     m_head->template unset_link_null<0>();
     m_head->template unset_link_null<1>();
     m_head->template set_link_null<0>();
-    insert(begin, end);
+    using category =
+      typename std::iterator_traits<InputIt>::iterator_category;
+    build(begin, end, category());
   }
 
   template <typename InputIt>
@@ -202,9 +276,57 @@ public:
   set(std::initializer_list<T> init, const Allocator& alloc = Allocator())
   : set(init, Compare(), alloc) {}
 
-  set(set&& rhs) : set<T, Compare, Allocator>() { swap(*this, rhs); }
+  // The allocator is shared with rhs rather than made anew, that
+  // would bring a storage of its own.
+  set(set&& rhs)
+  : m_inner_alloc(rhs.m_inner_alloc)
+  , m_head(get_node())
+  , m_comp(rhs.m_comp)
+  {
+    m_head->link[0] = m_head;
+    m_head->link[1] = m_head;
+    m_head->template unset_link_null<0>();
+    m_head->template unset_link_null<1>();
+    m_head->template set_link_null<0>();
+    swap(*this, rhs);
+  }
 
-  ~set() noexcept { clear(); release_node(m_head); }
+  // Reloads the set left by persist in the storage of alloc. A
+  // storage without root, like a new file, gets an empty set as its
+  // root.
+  set( from_root_t
+     , const Allocator& alloc
+     , const Compare& comp = Compare())
+  : m_inner_alloc(alloc_traits_type::select_on_container_copy_construction(alloc))
+  , m_head(m_inner_alloc.get_root())
+  , m_comp(comp)
+  {
+    if (m_head) {
+      m_size = static_cast<size_type>(std::distance(begin(), end()));
+      return;
+    }
+    m_head = get_node();
+    m_head->link[0] = m_head;
+    m_head->link[1] = m_head;
+    m_head->template unset_link_null<0>();
+    m_head->template unset_link_null<1>();
+    m_head->template set_link_null<0>();
+    persist();
+  }
+
+  // The set made persistent is left in its storage. Nodes the
+  // allocator drops on its own are not visited when there is nothing
+  // to destroy in them.
+  ~set() noexcept
+  {
+    if (inner_alloc_traits_type::is_root(m_inner_alloc, m_head))
+      return;
+    if (std::is_trivially_destructible<T>::value
+        && inner_alloc_traits_type::drops_nodes(m_inner_alloc))
+      return;
+    clear();
+    release_node(m_head);
+  }
 
   auto& operator=(set rhs) noexcept { swap(*this, rhs); return *this; }
 
@@ -213,17 +335,21 @@ public:
 
   void clear() noexcept
   {
+    // Nodes are released at once at the end.
+    node_chain<inner_alloc_type> chain(m_inner_alloc);
     node_pointer p = m_head;
     for (;;) {
       node_pointer q = tbst::inorder<1>(p);
       if (p != m_head) {
-        inner_alloc_traits_type::destroy(m_inner_alloc, &q->key);
-        release_node(p);
+        inner_alloc_traits_type::destroy(m_inner_alloc, &p->key);
+        chain.push(p);
       }
       if (q == m_head)
         break;
       p = q;
     }
+    chain.release();
+    m_size = 0;
     m_head->link[0] = m_head;
     m_head->link[1] = m_head;
     m_head->template unset_link_null<0>();
@@ -238,8 +364,7 @@ public:
   auto rend() const noexcept {return const_reverse_iterator(begin());}
   auto key_comp() const noexcept {return m_comp;}
   auto value_comp() const noexcept {return m_comp;}
-  auto size() const noexcept
-  {return static_cast<size_type>(std::distance(begin(), end()));}
+  auto size() const noexcept {return m_size;}
   bool empty() const noexcept {return begin() == end();}
   auto get_allocator() const noexcept {return m_inner_alloc;}
 
@@ -255,12 +380,416 @@ public:
   auto find(const K& key) const
   { return const_iterator(find_with_parent(m_head, key, m_comp).first); }
 
+  // The key at position k in order, end() if k is not less than
+  // size(). Like rank and count_range it needs tbst::ranked.
+  const_iterator nth(size_type k) const noexcept
+  {
+    static_assert(node_type::ranked, "set: nth needs tbst::ranked.");
+    return const_iterator(tbst::nth(m_head, k));
+  }
+
+  // Number of keys less than key, the position of the first key not
+  // less than it.
+  template <class K>
+  size_type rank(const K& key) const noexcept
+  {
+    static_assert(node_type::ranked, "set: rank needs tbst::ranked.");
+    return tbst::rank(m_head, key, m_comp);
+  }
+
+  // Number of keys in [lo, hi).
+  template <class K>
+  size_type count_range(const K& lo, const K& hi) const noexcept
+  {
+    if (!m_comp(lo, hi))
+      return 0;
+    return rank(hi) - rank(lo);
+  }
+
   template<typename K>
   auto max_size() const noexcept
   { return std::numeric_limits<size_type>::max(); }
 
   template <typename K>
   size_type erase(const K& key)
+  { return erase(key, Balance()); }
+
+  auto insert(const value_type& key) noexcept
+  {
+    auto get = [this](){ return get_node(); };
+    auto r = insert_with(key, copying(key, get), Balance());
+    if (r.second)
+      ++m_size;
+    return r;
+  }
+
+  // Inserts key next to hint if it belongs there, in constant time on
+  // the unbalanced tree, that looks only at the neighbours of hint.
+  // Balanced trees descend from the root all the same.
+  iterator insert(const_iterator hint, const value_type& key) noexcept
+  {
+    auto get = [this](){ return get_node(); };
+    auto r = insert_hint( to_node(hint.m_p), key, copying(key, get)
+                        , Balance());
+    if (r.second)
+      ++m_size;
+    return r.first;
+  }
+
+  // Constructs the key in a node from args, that is released if the
+  // key is already in the set.
+  template <class... Args>
+  std::pair<iterator, bool> emplace(Args&&... args)
+  {
+    auto q = make_node(std::forward<Args>(args)...);
+    if (!q)
+      return std::make_pair(iterator(m_head), false);
+    auto get = [q](){ return q; };
+    return insert_made(q, insert_with(q->key, get, Balance()));
+  }
+
+  template <class... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args)
+  {
+    auto q = make_node(std::forward<Args>(args)...);
+    if (!q)
+      return iterator(m_head);
+    auto get = [q](){ return q; };
+    auto r = insert_hint(to_node(hint.m_p), q->key, get, Balance());
+    return insert_made(q, r).first;
+  }
+
+  // The first key not less than key.
+  template <class K>
+  iterator lower_bound(const K& key)
+  { return iterator(tbst::bound<false>(m_head, key, m_comp)); }
+
+  template <class K>
+  const_iterator lower_bound(const K& key) const
+  { return const_iterator(tbst::bound<false>(m_head, key, m_comp)); }
+
+  // The first key greater than key.
+  template <class K>
+  iterator upper_bound(const K& key)
+  { return iterator(tbst::bound<true>(m_head, key, m_comp)); }
+
+  template <class K>
+  const_iterator upper_bound(const K& key) const
+  { return const_iterator(tbst::bound<true>(m_head, key, m_comp)); }
+
+  template <class K>
+  std::pair<iterator, iterator> equal_range(const K& key)
+  { return std::make_pair(lower_bound(key), upper_bound(key)); }
+
+  template <class K>
+  std::pair<const_iterator, const_iterator>
+  equal_range(const K& key) const
+  { return std::make_pair(lower_bound(key), upper_bound(key)); }
+
+  template<class InputIt>
+  void insert(InputIt begin, InputIt end) noexcept
+  {
+    using category =
+      typename std::iterator_traits<InputIt>::iterator_category;
+    insert(begin, end, category());
+  }
+
+  // Replaces the content of the set with [first, last), that must be
+  // sorted and free of equivalent keys. The tree is built balanced in
+  // O(n), its nodes taken from the allocator in order, so that
+  // traversals follow memory. Keys past what a fixed size allocator
+  // can hold are left out.
+  template <class ForwardIt>
+  void assign_sorted(ForwardIt first, ForwardIt last) noexcept
+  {
+    clear();
+    const auto n = static_cast<size_type>(std::distance(first, last));
+
+    // The nodes are first chained in order through link[1], starting
+    // at that of the head.
+    auto tail = m_head;
+    size_type m = 0;
+    while (m < n) {
+      auto run =
+        inner_alloc_traits_type::allocate_nodes(m_inner_alloc, n - m);
+      if (run.first == run.second || !run.first)
+        break;
+      for (; run.first != run.second; ++run.first, ++m, ++first) {
+        safe_construct(run.first, *first);
+        tail->link[1] = run.first;
+        tail = run.first;
+      }
+    }
+    link_chain(m);
+  }
+
+  // Moves in the keys of other that are not in the set, leaving the
+  // others there. Both sets are rebuilt balanced in O(n + m). Nodes
+  // are moved as they are when the allocators compare equal, keys
+  // are copied otherwise. Keys a fixed size allocator cannot take
+  // stay in other.
+  void merge(set& other) noexcept
+  {
+    if (this == &other)
+      return;
+
+    const bool shared = m_inner_alloc == other.m_inner_alloc;
+    node_chain<inner_alloc_type> dropped(other.m_inner_alloc);
+    auto tail = m_head;
+    auto other_tail = other.m_head;
+    size_type m = 0;
+    size_type other_m = 0;
+    auto p = tbst::inorder<1>(m_head);
+    auto q = tbst::inorder<1>(other.m_head);
+    while (p != m_head || q != other.m_head) {
+      if (q == other.m_head
+          || (p != m_head && m_comp(p->key, q->key))) {
+        auto next = tbst::inorder<1>(p);
+        append(tail, p, m);
+        p = next;
+      } else if (p == m_head || m_comp(q->key, p->key)) {
+        auto next = tbst::inorder<1>(q);
+        if (shared) {
+          append(tail, q, m);
+        } else if (append_copy(tail, q->key, m)) {
+          inner_alloc_traits_type::destroy(other.m_inner_alloc, &q->key);
+          dropped.push(q);
+        } else {
+          append(other_tail, q, other_m);
+        }
+        q = next;
+      } else {
+        auto next = tbst::inorder<1>(p);
+        auto other_next = tbst::inorder<1>(q);
+        append(tail, p, m);
+        append(other_tail, q, other_m);
+        p = next;
+        q = other_next;
+      }
+    }
+    dropped.release();
+    link_chain(m);
+    other.link_chain(other_m);
+  }
+
+  // Keys in lhs or in rhs, in lhs and in rhs, and in lhs but not in
+  // rhs. The result is built balanced in O(n + m) from the nodes of
+  // lhs, so that passing it as an rvalue spares the copy. Keys of
+  // rhs past what a fixed size allocator can hold are left out of
+  // the union, as in assign_sorted.
+  friend set set_union(set lhs, const set& rhs) noexcept
+  {
+    lhs.combine(rhs, true, true, true);
+    return lhs;
+  }
+
+  friend set set_intersection(set lhs, const set& rhs) noexcept
+  {
+    lhs.combine(rhs, false, true, false);
+    return lhs;
+  }
+
+  friend set set_difference(set lhs, const set& rhs) noexcept
+  {
+    lhs.combine(rhs, true, false, false);
+    return lhs;
+  }
+
+  // Makes the set the root of the storage of its allocator, that must
+  // be persistent, see persistent_policy. The set is then left in the
+  // storage when destroyed, to be reloaded with the from_root
+  // constructor.
+  void persist() { m_inner_alloc.set_root(m_head); }
+
+  // Moves the nodes of the set to the lowest slots of the storage of
+  // its allocator, that must hold no other node, and releases the
+  // blocks left empty. Iterators are invalidated. Returns the number
+  // of nodes moved, always zero for allocators without node storage.
+  size_type compact()
+  {
+    auto head = m_head;
+    const auto n = inner_alloc_traits_type::compact(m_inner_alloc,
+      [&](node_pointer from, node_pointer to, auto fwd)
+      {
+        if (from == m_head)
+          head = to;
+        to->link[0] = fwd(to->link[0]);
+        to->link[1] = fwd(to->link[1]);
+      });
+    m_head = head;
+    return n;
+  }
+
+  friend void swap(set& lhs, set& rhs) noexcept
+  {
+    using std::swap;
+    swap(lhs.m_inner_alloc, rhs.m_inner_alloc);
+    swap(lhs.m_head       , rhs.m_head);
+    swap(lhs.m_comp       , rhs.m_comp);
+    swap(lhs.m_size       , rhs.m_size);
+  }
+
+private:
+  // Height of a tree of n nodes built by build_balanced.
+  static int balanced_height(size_type n) noexcept
+  {
+    int h = 0;
+    for (; n != 0; n >>= 1)
+      ++h;
+    return h;
+  }
+
+  // Builds a balanced subtree with the n nodes chained from next and
+  // returns its root. prev is the node last placed, whose thread to
+  // its successor is set here.
+  node_pointer build_balanced( size_type n, node_pointer& next
+                             , node_pointer& prev) noexcept
+  {
+    const auto nl = (n - 1) / 2;
+    const auto nr = n - 1 - nl;
+    auto left = m_head;
+    if (nl != 0)
+      left = build_balanced(nl, next, prev);
+
+    auto p = next;
+    next = p->link[1];
+    p->set_balance(balanced_height(nr) - balanced_height(nl));
+    p->set_count(n);
+    if (nl != 0) {
+      p->link[0] = left;
+      p->template unset_link_null<0>();
+    } else {
+      p->link[0] = prev;
+      p->template set_link_null<0>();
+    }
+    if (prev != m_head && prev->template get_null_link<1>())
+      prev->link[1] = p;
+    prev = p;
+
+    if (nr == 0) {
+      p->template set_link_null<1>();
+      return p;
+    }
+    p->template unset_link_null<1>();
+    auto right = build_balanced(nr, next, prev);
+    p->link[1] = right;
+    return p;
+  }
+
+  // Replaces the tree with the m nodes chained in order through
+  // link[1] from the head, that hold their keys.
+  void link_chain(size_type m) noexcept
+  {
+    m_size = m;
+    if (m == 0) {
+      m_head->link[0] = m_head;
+      m_head->link[1] = m_head;
+      m_head->template set_link_null<0>();
+      return;
+    }
+
+    auto next = m_head;
+    next = m_head->link[1];
+    auto prev = m_head;
+    auto root = build_balanced(m, next, prev);
+    prev->link[1] = m_head;
+    m_head->link[0] = root;
+    m_head->link[1] = m_head;
+    m_head->template unset_link_null<0>();
+  }
+
+  // Adds p at the end of the chain ending at tail, of m nodes.
+  static void append(node_pointer& tail, node_pointer p, size_type& m)
+  noexcept
+  {
+    tail->link[1] = p;
+    tail = p;
+    ++m;
+  }
+
+  // Adds a node with a copy of key, unless the allocator runs out.
+  // Returns whether it did.
+  bool append_copy( node_pointer& tail, const value_type& key
+                  , size_type& m) noexcept
+  {
+    auto q = get_node();
+    if (!q)
+      return false;
+    safe_construct(q, key);
+    append(tail, q, m);
+    return true;
+  }
+
+  // Walks the set and other in step and rebuilds the set with the
+  // keys found only in it, in both, or only in other, as told. The
+  // nodes of the set are kept or released, keys of other copied.
+  void combine( const set& other, bool only_this, bool both
+              , bool only_other) noexcept
+  {
+    node_chain<inner_alloc_type> dropped(m_inner_alloc);
+    auto tail = m_head;
+    size_type m = 0;
+    auto keep = [&](node_pointer p, bool b)
+    {
+      if (b) {
+        append(tail, p, m);
+      } else {
+        inner_alloc_traits_type::destroy(m_inner_alloc, &p->key);
+        dropped.push(p);
+      }
+    };
+
+    auto p = tbst::inorder<1>(m_head);
+    auto q = tbst::inorder<1>(other.m_head);
+    while (p != m_head || q != other.m_head) {
+      if (q == other.m_head
+          || (p != m_head && m_comp(p->key, q->key))) {
+        auto next = tbst::inorder<1>(p);
+        keep(p, only_this);
+        p = next;
+      } else if (p == m_head || m_comp(q->key, p->key)) {
+        if (only_other)
+          append_copy(tail, q->key, m);
+        q = tbst::inorder<1>(q);
+      } else {
+        auto next = tbst::inorder<1>(p);
+        keep(p, both);
+        p = next;
+        q = tbst::inorder<1>(q);
+      }
+    }
+    dropped.release();
+    link_chain(m);
+  }
+
+  // Builds the set from a range, sorted first unless it already is.
+  // Of equivalent keys the first is kept, as insert would.
+  template <class InputIt>
+  void build(InputIt begin, InputIt end, std::input_iterator_tag)
+  noexcept
+  {
+    std::vector<value_type> v(begin, end);
+    std::stable_sort(std::begin(v), std::end(v), m_comp);
+    auto equiv = [this](const value_type& a, const value_type& b)
+    { return !m_comp(a, b); };
+    v.erase(std::unique(std::begin(v), std::end(v), equiv), std::end(v));
+    assign_sorted(std::begin(v), std::end(v));
+  }
+
+  template <class ForwardIt>
+  void build(ForwardIt begin, ForwardIt end, std::forward_iterator_tag)
+  noexcept
+  {
+    auto unordered = [this](const value_type& a, const value_type& b)
+    { return !m_comp(a, b); };
+    if (std::adjacent_find(begin, end, unordered) == end)
+      assign_sorted(begin, end);
+    else
+      build(begin, end, std::input_iterator_tag());
+  }
+
+  template <typename K>
+  size_type erase(const K& key, tbst::unbalanced)
   {
     auto pair = find_with_parent(m_head, key, m_comp);
     if (pair.first == m_head)
@@ -268,14 +797,34 @@ public:
 
     auto r = tbst::erase_node<1>(pair.second, pair.first);
     release_node(r);
+    --m_size;
     return 1;
   }
 
-  auto insert(const value_type& key) noexcept
+  template <typename K>
+  size_type erase(const K& key, tbst::avl)
+  {
+    auto r = tbst::avl_erase(m_head, key, m_comp);
+    if (r == m_head)
+      return 0;
+
+    release_node(r);
+    --m_size;
+    return 1;
+  }
+
+  // Inserts key with the node obtained from get, that holds a copy of
+  // it and is called only if key is not yet in the tree. Nothing is
+  // inserted if get returns a null node, as a fixed size allocator
+  // does when it runs out.
+  template <class F>
+  std::pair<iterator, bool>
+  insert_with(const value_type& key, F get, tbst::unbalanced) noexcept
   {
     if (m_head->template get_null_link<0>()) { // The tree is empty
-      auto q = get_node();
-      safe_construct(q, key);
+      auto q = get();
+      if (!q)
+        return std::make_pair(iterator(m_head), false);
       tbst::attach_node<0>(m_head, q);
       return std::make_pair(iterator(q), true);
     }
@@ -287,8 +836,9 @@ public:
         if (!p->template get_null_link<0>()) {
           p = p->link[0];
         } else {
-          auto q = get_node();
-          safe_construct(q, key);
+          auto q = get();
+          if (!q)
+            return std::make_pair(iterator(m_head), false);
           tbst::attach_node<0>(p, q);
           return std::make_pair(iterator(q), true);
         }
@@ -296,8 +846,9 @@ public:
         if (!p->template get_null_link<1>()) {
           p = p->link[1];
         } else {
-          auto q = get_node();
-          safe_construct(q, key);
+          auto q = get();
+          if (!q)
+            return std::make_pair(iterator(m_head), false);
           tbst::attach_node<1>(p, q);
           return std::make_pair(iterator(q), true);
         }
@@ -307,37 +858,165 @@ public:
     }
   }
 
-  template<class InputIt>
-  void insert(InputIt begin, InputIt end) noexcept
+  template <class F>
+  std::pair<iterator, bool>
+  insert_with(const value_type& key, F get, tbst::avl) noexcept
+  {
+    if (m_head->template get_null_link<0>())
+      return insert_with(key, get, tbst::unbalanced());
+
+    // Balances change only below y, the last node with a nonzero
+    // balance on the path, whose parent is z.
+    auto z = m_head;
+    auto y = m_head;
+    y = m_head->link[0];
+    auto q = z;
+    auto p = y;
+    bool da[tbst::avl_max_height];
+    std::size_t k = 0;
+    for (;;) {
+      const bool d = !m_comp(key, p->key);
+      if (d && !m_comp(p->key, key)) {
+        if (node_type::ranked)
+          tbst::uncount_path(m_head, key, m_comp);
+        return std::make_pair(iterator(p), false);
+      }
+      p->add_count(1);
+      if (p->get_balance() != 0) {
+        z = q;
+        y = p;
+        k = 0;
+      }
+      da[k++] = d;
+      if (p->get_null_link(d))
+        break;
+      q = p;
+      p = p->link[d];
+    }
+
+    auto n = get();
+    if (!n) {
+      if (node_type::ranked)
+        tbst::uncount_path(m_head, key, m_comp);
+      return std::make_pair(iterator(m_head), false);
+    }
+    if (da[k - 1])
+      tbst::attach_node<1>(p, n);
+    else
+      tbst::attach_node<0>(p, n);
+    tbst::avl_insert_fixup(z, y, n, da);
+    return std::make_pair(iterator(n), true);
+  }
+
+  template <class F>
+  std::pair<iterator, bool>
+  insert_hint( node_pointer h, const value_type& key, F get
+             , tbst::unbalanced) noexcept
   {
-    for (InputIt iter = begin; iter != end; ++iter) {
-      auto pair = insert(*iter);
-      if (!pair.second)
-         continue;
+    if (m_head->template get_null_link<0>()) // The tree is empty
+      return insert_with(key, get, tbst::unbalanced());
+
+    // The hint is moved a few neighbours towards key before giving
+    // up on it.
+    for (int i = 0; i < hint_reach; ++i) {
+      if (h == m_head || m_comp(key, h->key)) {
+        // Goes right before h if after its predecessor p.
+        auto p = tbst::inorder<0>(h);
+        if (p == m_head || m_comp(p->key, key)) {
+          if (h != m_head && h->template get_null_link<0>())
+            return attach_with<0>(h, get);
+          return attach_with<1>(p, get);
+        }
+        if (!m_comp(key, p->key))
+          return std::make_pair(iterator(p), false);
+        h = p;
+      } else if (m_comp(h->key, key)) {
+        // Goes right after h if before its successor s.
+        auto s = tbst::inorder<1>(h);
+        if (s == m_head || m_comp(key, s->key)) {
+          if (h->template get_null_link<1>())
+            return attach_with<1>(h, get);
+          return attach_with<0>(s, get);
+        }
+        if (!m_comp(s->key, key))
+          return std::make_pair(iterator(s), false);
+        h = s;
+      } else {
+        return std::make_pair(iterator(h), false);
+      }
     }
+    return insert_with(key, get, tbst::unbalanced());
   }
 
-  friend void swap(set& lhs, set& rhs) noexcept
+  template <class F>
+  std::pair<iterator, bool>
+  insert_hint(node_pointer, const value_type& key, F get, tbst::avl)
+  noexcept
+  { return insert_with(key, get, tbst::avl()); }
+
+  // Attaches the node from get as child I of p, whose link I must be
+  // null.
+  template <std::size_t I, class F>
+  std::pair<iterator, bool> attach_with(node_pointer p, F get) noexcept
   {
-    using std::swap;
-    swap(lhs.m_inner_alloc, rhs.m_inner_alloc);
-    swap(lhs.m_head       , rhs.m_head);
-    swap(lhs.m_comp       , rhs.m_comp);
+    auto q = get();
+    if (!q)
+      return std::make_pair(iterator(m_head), false);
+    tbst::attach_node<I>(p, q);
+    return std::make_pair(iterator(q), true);
+  }
+
+  template<class InputIt>
+  void insert(InputIt begin, InputIt end, std::input_iterator_tag)
+  noexcept
+  {
+    for (InputIt iter = begin; iter != end; ++iter)
+      insert(*iter);
+  }
+
+  template<class InputIt>
+  void insert(InputIt begin, InputIt end, std::forward_iterator_tag)
+  noexcept
+  {
+    // Nodes are taken from the allocator in runs of adjacent nodes.
+    auto n = static_cast<size_type>(std::distance(begin, end));
+    std::pair<node_pointer, node_pointer> run;
+    auto get = [&]()
+    {
+      if (run.first == run.second)
+        run = inner_alloc_traits_type::allocate_nodes(m_inner_alloc, n);
+      if (run.first == run.second)
+        return node_pointer();
+      auto q = run.first;
+      ++run.first;
+      return q;
+    };
+
+    for (InputIt iter = begin; iter != end; ++iter, --n) {
+      const value_type& key = *iter;
+      if (insert_with(key, copying(key, get), Balance()).second)
+        ++m_size;
+    }
+
+    // Releases what was not used due to repeated keys.
+    node_chain<inner_alloc_type> chain(m_inner_alloc);
+    for (; run.first != run.second; ++run.first)
+      chain.push(run.first);
+    chain.release();
   }
 };
 
-template<typename Key, typename Compare, typename Alloc>
-bool operator==( const set<Key, Compare, Alloc>& lhs
-               , const set<Key, Compare, Alloc>& rhs) noexcept
+template<typename Key, typename Compare, typename Alloc, typename B>
+bool operator==( const set<Key, Compare, Alloc, B>& lhs
+               , const set<Key, Compare, Alloc, B>& rhs) noexcept
 {
-  const bool b1 = lhs.size() == rhs.size();
-  const bool b2 = std::equal(std::begin(lhs), std::end(lhs), std::begin(rhs));
-  return b1 && b2;
+  return lhs.size() == rhs.size()
+    && std::equal(std::begin(lhs), std::end(lhs), std::begin(rhs));
 }
 
-template<typename Key, typename Compare, typename Alloc>
-bool operator!=( const set<Key, Compare, Alloc>& lhs
-               , const set<Key, Compare, Alloc>& rhs) noexcept
+template<typename Key, typename Compare, typename Alloc, typename B>
+bool operator!=( const set<Key, Compare, Alloc, B>& lhs
+               , const set<Key, Compare, Alloc, B>& rhs) noexcept
 { return !(lhs == rhs); }
 
 }
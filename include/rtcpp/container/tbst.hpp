@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <ostream>
+#include <type_traits>
 
 #include <rtcpp/memory/allocator_traits.hpp>
 
@@ -16,17 +17,65 @@ namespace rt { namespace tbst {
 
 constexpr int dir[2] = {1, 0};
 
-template <class T, class Ptr>
-class node {
+// Balancing policies of rt::set. With avl the heights of the two
+// subtrees of a node differ by at most one, the difference being
+// kept in the tag of the node.
+struct unbalanced {};
+struct avl {};
+
+// An avl tree whose nodes also keep the size of their subtree, for
+// order statistics in logarithmic time, see set::nth.
+struct ranked : avl {};
+
+// Height of an AVL tree with less than 2^64 nodes, with some room.
+constexpr std::size_t avl_max_height = 96;
+
+// Type of the subtree sizes, that of the indexes of the nodes if
+// they are linked by index.
+template <class Ptr, class = void>
+struct count_type { using type = std::size_t; };
+
+template <class Ptr>
+struct count_type<Ptr, typename std::enable_if<
+  std::is_integral<typename Ptr::index_type>::value>::type> {
+  using type = typename Ptr::index_type;
+};
+
+template <class C, bool Ranked>
+class node_count {
+public:
+  static constexpr bool ranked = false;
+  constexpr std::size_t get_count() const noexcept { return 0; }
+  void set_count(std::size_t) noexcept {}
+  void add_count(int) noexcept {}
+};
+
+template <class C>
+class node_count<C, true> {
+private:
+  C count = 0;
+
+public:
+  static constexpr bool ranked = true;
+  std::size_t get_count() const noexcept { return count; }
+  void set_count(std::size_t c) noexcept { count = static_cast<C>(c); }
+  void add_count(int d) noexcept { count = static_cast<C>(count + d); }
+};
+
+template <class T, class Ptr, bool Ranked = false>
+class node
+  : public node_count<typename count_type<Ptr>::type, Ranked> {
 public:
   template <class U, class K>
-  using self_type = node<U, K>;
+  using self_type = node<U, K, Ranked>;
   using value_type = T;
   using link_type = typename decide_link_type<self_type, T, Ptr>::type;
 
 private:
   static constexpr unsigned char null_link_bit = 1;
   static constexpr unsigned char in_use_bit = 4;
+  static constexpr unsigned char balance_shift = 3;
+  static constexpr unsigned char balance_mask = 3 << balance_shift;
   unsigned char tag = 0;
 
 public:
@@ -34,7 +83,7 @@ public:
   T key;
 
   template<class U, class K>
-  using rebind = node<U , K>;
+  using rebind = node<U , K, Ranked>;
 
   template <int I>
   void set_link_null() noexcept
@@ -49,20 +98,33 @@ public:
 
   template <int I>
   void reset_one_link_bit() noexcept
-  { tag &= (null_link_bit << I) | in_use_bit; }
+  { tag &= (null_link_bit << I) | in_use_bit | balance_mask; }
 
   template <int I>
   constexpr unsigned char get_null_link() const noexcept
   { return tag & (null_link_bit << I); }
 
+  constexpr unsigned char get_null_link(int i) const noexcept
+  { return tag & (null_link_bit << i); }
+
+  // Height of the right subtree minus that of the left, see avl.
+  int get_balance() const noexcept
+  { return ((tag & balance_mask) >> balance_shift) - 1; }
+
+  void set_balance(int b) noexcept
+  {
+    tag = static_cast<unsigned char>(
+      (tag & ~balance_mask) | ((b + 1) << balance_shift));
+  }
+
   void mark_in_use() noexcept { tag |= in_use_bit; }
   void mark_free() noexcept { tag &= ~in_use_bit; }
   bool is_in_use() const noexcept { return tag & in_use_bit; }
 };
 
-template <class T, class Ptr>
+template <class T, class Ptr, bool Ranked>
 std::ostream&
-operator<<(std::ostream& os, const node<T, Ptr>& o)
+operator<<(std::ostream& os, const node<T, Ptr, Ranked>& o)
 {
   os << o.key;
   return os;
@@ -137,6 +199,8 @@ void attach_node(Ptr p, Ptr q) noexcept
   // Does not check if pointers are valid.
   q->link[I] = p->link[I];
   q->template reset_one_link_bit<dir[I]>();
+  q->set_balance(0);
+  q->set_count(1);
   q->set_link_null(p->template get_null_link<I>());
   p->link[I] = q;
   p->template reset_one_link_bit<dir[I]>();
@@ -227,6 +291,215 @@ Ptr erase_node(Ptr pq, Ptr q) noexcept
   return q;
 }
 
+template <std::size_t I, class Ptr>
+std::size_t child_count(Ptr p) noexcept
+{
+  if (p->template get_null_link<I>())
+    return 0;
+  auto q = p;
+  q = p->link[I];
+  return q->get_count();
+}
+
+template <class Ptr>
+void update_count(Ptr p) noexcept
+{
+  if (p->ranked)
+    p->set_count(child_count<0>(p) + child_count<1>(p) + 1);
+}
+
+template <std::size_t I, class Ptr>
+Ptr avl_rotate(Ptr y) noexcept
+{
+  // The subtree of y on side I is two levels higher than the other.
+  // Returns the new root of the subtree, that is one level lower than
+  // before unless its balance is not zero.
+  constexpr int s = I ? 1 : -1;
+  const auto c = y->get_count();
+  auto x = y;
+  x = y->link[I];
+  if (x->get_balance() != -s) { // Single rotation.
+    if (x->template get_null_link<dir[I]>()) {
+      x->template unset_link_null<dir[I]>();
+      y->template set_link_null<I>();
+    } else {
+      y->link[I] = x->link[dir[I]];
+    }
+    x->link[dir[I]] = y;
+    const int b = x->get_balance();
+    x->set_balance(b ? 0 : -s);
+    y->set_balance(b ? 0 : s);
+    update_count(y);
+    x->set_count(c);
+    return x;
+  }
+
+  auto w = x; // Double rotation.
+  w = x->link[dir[I]];
+  x->link[dir[I]] = w->link[I];
+  w->link[I] = x;
+  y->link[I] = w->link[dir[I]];
+  w->link[dir[I]] = y;
+  const int b = w->get_balance();
+  x->set_balance(b == -s ? s : 0);
+  y->set_balance(b == s ? -s : 0);
+  w->set_balance(0);
+  if (w->template get_null_link<I>()) {
+    x->link[dir[I]] = w;
+    x->template set_link_null<dir[I]>();
+    w->template unset_link_null<I>();
+  }
+  if (w->template get_null_link<dir[I]>()) {
+    y->link[I] = w;
+    y->template set_link_null<I>();
+    w->template unset_link_null<dir[I]>();
+  }
+  update_count(x);
+  update_count(y);
+  w->set_count(c);
+  return w;
+}
+
+template <class Ptr>
+void avl_insert_fixup(Ptr z, Ptr y, Ptr n, const bool* da) noexcept
+{
+  // n was just attached below y, the last node on its path with a
+  // nonzero balance, da holding the directions taken from y. z is the
+  // parent of y.
+  const int b = y->get_balance() + (da[0] ? 1 : -1);
+  auto p = y;
+  p = y->link[da[0]];
+  for (std::size_t k = 1; p != n; ++k) {
+    p->set_balance(da[k] ? 1 : -1);
+    p = p->link[da[k]];
+  }
+
+  if (b != 2 && b != -2) {
+    y->set_balance(b);
+    return;
+  }
+
+  auto w = b == 2 ? avl_rotate<1>(y) : avl_rotate<0>(y);
+  if (z->link[0] == y)
+    z->link[0] = w;
+  else
+    z->link[1] = w;
+}
+
+template <class Ptr, class K, class Comp>
+Ptr avl_erase(Ptr head, const K& key, const Comp& comp) noexcept
+{
+  // Unlinks the node equivalent to key and rebalances the tree.
+  // Returns the node to be released elsewhere or head if there is
+  // none.
+  if (head->template get_null_link<0>()) // The tree is empty
+    return head;
+
+  // The path from the head, each node with the direction taken.
+  Ptr pa[avl_max_height];
+  bool da[avl_max_height];
+  std::size_t k = 0;
+  pa[k] = head;
+  da[k++] = false;
+  auto p = head;
+  p = head->link[0];
+  for (;;) {
+    const bool d = !comp(key, p->key);
+    if (d && !comp(p->key, key))
+      break;
+    if (p->get_null_link(d))
+      return head;
+    pa[k] = p;
+    da[k++] = d;
+    p = p->link[d];
+  }
+
+  auto q = pa[k - 1];
+  const bool d = da[k - 1];
+  if (p->template get_null_link<1>()) {
+    if (!p->template get_null_link<0>()) {
+      auto t = inorder<0>(p);
+      t->link[1] = p->link[1];
+      q->link[d] = p->link[0];
+    } else {
+      q->link[d] = p->link[d];
+      if (d)
+        q->template set_link_null<1>();
+      else
+        q->template set_link_null<0>();
+    }
+  } else {
+    auto r = p;
+    r = p->link[1];
+    if (r->template get_null_link<0>()) { // r replaces p.
+      r->link[0] = p->link[0];
+      if (!p->template get_null_link<0>()) {
+        r->template unset_link_null<0>();
+        auto t = inorder<0>(p);
+        t->link[1] = r;
+      }
+      q->link[d] = r;
+      r->set_balance(p->get_balance());
+      r->set_count(p->get_count());
+      pa[k] = r;
+      da[k++] = true;
+    } else { // The successor s of p replaces it.
+      const auto j = k++;
+      auto s = r;
+      for (;;) {
+        pa[k] = r;
+        da[k++] = false;
+        s = r->link[0];
+        if (s->template get_null_link<0>())
+          break;
+        r = s;
+      }
+      if (!s->template get_null_link<1>()) {
+        r->link[0] = s->link[1];
+      } else {
+        r->link[0] = s;
+        r->template set_link_null<0>();
+      }
+      s->link[0] = p->link[0];
+      if (!p->template get_null_link<0>()) {
+        auto t = inorder<0>(p);
+        t->link[1] = s;
+        s->template unset_link_null<0>();
+      }
+      s->link[1] = p->link[1];
+      s->template unset_link_null<1>();
+      q->link[d] = s;
+      s->set_balance(p->get_balance());
+      s->set_count(p->get_count());
+      pa[j] = s;
+      da[j] = true;
+    }
+  }
+
+  if (p->ranked)
+    for (std::size_t i = 1; i < k; ++i)
+      pa[i]->add_count(-1);
+
+  // Walks up while the subtrees on the path get lower.
+  while (--k > 0) {
+    auto y = pa[k];
+    const int b = y->get_balance() + (da[k] ? -1 : 1);
+    if (b == 0) {
+      y->set_balance(0);
+      continue;
+    }
+    if (b == 1 || b == -1) {
+      y->set_balance(b);
+      break;
+    }
+    auto w = b == 2 ? avl_rotate<1>(y) : avl_rotate<0>(y);
+    pa[k - 1]->link[da[k - 1]] = w;
+    if (w->get_balance() != 0)
+      break;
+  }
+  return p;
+}
+
 template <class Ptr, class K, class Comp>
 std::pair<Ptr, Ptr>
 find_with_parent(Ptr head, const K& key, const Comp& comp)
@@ -282,6 +555,103 @@ void copy(Ptr head1, Ptr head2, C get_node) noexcept
     }
 
     q->key = p->key;
+    q->set_balance(p->get_balance());
+    q->set_count(p->get_count());
+  }
+}
+
+template <class Ptr, class K, class Comp>
+void uncount_path(Ptr head, const K& key, const Comp& comp) noexcept
+{
+  // Takes one from the subtree sizes on the path to key, down to the
+  // node equivalent to it, left as is, or to a leaf.
+  auto p = head;
+  p = head->link[0];
+  for (;;) {
+    const bool d = !comp(key, p->key);
+    if (d && !comp(p->key, key))
+      return;
+    p->add_count(-1);
+    if (p->get_null_link(d))
+      return;
+    p = p->link[d];
+  }
+}
+
+template <bool Upper, class Ptr, class K, class Comp>
+Ptr bound(Ptr head, const K& key, const Comp& comp)
+{
+  // The first node whose key is not less than key, greater than it
+  // if Upper, head if there is none.
+  if (head->template get_null_link<0>()) // The tree is empty
+    return head;
+
+  auto r = head;
+  auto p = head;
+  p = head->link[0];
+  for (;;) {
+    if (Upper ? comp(key, p->key) : !comp(p->key, key)) {
+      r = p;
+      if (p->template get_null_link<0>())
+        return r;
+      p = p->link[0];
+    } else {
+      if (p->template get_null_link<1>())
+        return r;
+      p = p->link[1];
+    }
+  }
+}
+
+template <class Ptr>
+Ptr nth(Ptr head, std::size_t k) noexcept
+{
+  // The node at position k in order in a ranked tree, head if there
+  // is none.
+  if (head->template get_null_link<0>()) // The tree is empty
+    return head;
+
+  auto p = head;
+  p = head->link[0];
+  if (k >= p->get_count())
+    return head;
+
+  for (;;) {
+    const auto l = child_count<0>(p);
+    if (k == l)
+      return p;
+    if (k < l) {
+      p = p->link[0];
+    } else {
+      k -= l + 1;
+      p = p->link[1];
+    }
+  }
+}
+
+template <class Ptr, class K, class Comp>
+std::size_t rank(Ptr head, const K& key, const Comp& comp) noexcept
+{
+  // Number of keys less than key in a ranked tree.
+  if (head->template get_null_link<0>()) // The tree is empty
+    return 0;
+
+  std::size_t r = 0;
+  auto p = head;
+  p = head->link[0];
+  for (;;) {
+    if (comp(key, p->key)) {
+      if (p->template get_null_link<0>())
+        return r;
+      p = p->link[0];
+    } else if (comp(p->key, key)) {
+      r += child_count<0>(p) + 1;
+      if (p->template get_null_link<1>())
+        return r;
+      p = p->link[1];
+    } else {
+      return r + child_count<0>(p);
+    }
   }
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <utility>
 #include <type_traits>
 
 #include "node_traits.hpp"
@@ -41,6 +42,11 @@ struct decide_link_type<Node, T, Link, true> {
     rebind<Node<T, Link>>;
 };
 
+// Selects the constructor of a container that reloads it from the
+// root of a persistent storage, see persistent_policy.
+struct from_root_t {};
+constexpr from_root_t from_root {};
+
 //__________________________________________________________________
 template <typename Alloc>
 struct allocator_traits {
@@ -86,6 +92,23 @@ struct allocator_traits {
   make_ptr(Alloc2&, typename Alloc2::pointer l)
   {return l;}
 
+  // Returns a run [first, last) of at most n nodes, iterated with
+  // operator++. Allocators without allocate_nodes give one node.
+  template <typename Alloc2 = Alloc>
+  static typename std::enable_if<
+    has_allocate_nodes<Alloc2>::value, std::pair<pointer, pointer>>::type
+  allocate_nodes(Alloc2& a, size_type n) {return a.allocate_nodes(n);}
+
+  template <typename Alloc2 = Alloc>
+  static typename std::enable_if<
+    !has_allocate_nodes<Alloc2>::value, std::pair<pointer, pointer>>::type
+  allocate_nodes(Alloc2& a, size_type)
+  {
+    auto p = allocate_node(a);
+    auto q = p;
+    return std::make_pair(p, ++q);
+  }
+
   static pointer allocate(Alloc& a, size_type n)
   {return a.allocate(n);}
 
@@ -99,6 +122,40 @@ struct allocator_traits {
   std::enable_if<!rt::has_allocate_node<Alloc2>::value>::type
   deallocate_node(Alloc2& a, pointer p) {a.deallocate(p, 1);}
 
+  // Moves the nodes in use to the lowest slots of the storage, see
+  // node_storage::compact. Allocators without it move nothing.
+  template <typename F, typename Alloc2 = Alloc>
+  static typename std::enable_if<
+    has_compact<Alloc2>::value, size_type>::type
+  compact(Alloc2& a, F f) {return a.compact(f);}
+
+  template <typename F, typename Alloc2 = Alloc>
+  static typename std::enable_if<
+    !has_compact<Alloc2>::value, size_type>::type
+  compact(Alloc2&, F) {return 0;}
+
+  // Whether p is the root of a persistent storage, that containers
+  // leave in place when destroyed.
+  template <typename Alloc2 = Alloc>
+  static typename std::enable_if<has_root<Alloc2>::value, bool>::type
+  is_root(const Alloc2& a, pointer p) {return p == a.get_root();}
+
+  template <typename Alloc2 = Alloc>
+  static typename std::enable_if<!has_root<Alloc2>::value, bool>::type
+  is_root(const Alloc2&, pointer) {return false;}
+
+  // Whether the nodes of a container may be left to the allocator
+  // instead of released one by one, see node_allocator::drops_nodes.
+  template <typename Alloc2 = Alloc>
+  static typename std::enable_if<
+    has_drops_nodes<Alloc2>::value, bool>::type
+  drops_nodes(const Alloc2& a) {return a.drops_nodes();}
+
+  template <typename Alloc2 = Alloc>
+  static typename std::enable_if<
+    !has_drops_nodes<Alloc2>::value, bool>::type
+  drops_nodes(const Alloc2&) {return false;}
+
   static void deallocate(Alloc& a, pointer p, size_type n)
   {a.deallocate(p, n);}
 
@@ -109,5 +166,52 @@ struct allocator_traits {
   {a.construct(p, std::forward<Args>(args)...);}
 };
 
+//__________________________________________________________________
+// Collects nodes to be released at once with release(). Allocators
+// without allocate_nodes get each node released on push.
+template <class Alloc, bool B = has_allocate_nodes<Alloc>::value>
+class node_chain {
+private:
+  using pointer = typename Alloc::pointer;
+  Alloc& alloc;
+  pointer first;
+  pointer last;
+
+public:
+  explicit node_chain(Alloc& a) noexcept
+  : alloc(a), first(nullptr), last(nullptr) {}
+
+  void push(pointer p) noexcept
+  {
+    if (!last)
+      last = p;
+    else
+      alloc.link_node(p, first);
+    first = p;
+  }
+
+  void release() noexcept
+  {
+    if (last)
+      alloc.deallocate_chain(first, last);
+    first = pointer();
+    last = pointer();
+  }
+};
+
+template <class Alloc>
+class node_chain<Alloc, false> {
+private:
+  Alloc& alloc;
+
+public:
+  explicit node_chain(Alloc& a) noexcept : alloc(a) {}
+
+  void push(typename Alloc::pointer p) noexcept
+  { allocator_traits<Alloc>::deallocate_node(alloc, p); }
+
+  void release() noexcept {}
+};
+
 }
 
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace rt {
+
+inline unsigned count_trailing_zeros(std::uint64_t x) noexcept
+{
+#if defined(__GNUC__)
+  return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+  unsigned n = 0;
+  for (; !(x & 1); x >>= 1)
+    ++n;
+  return n;
+#endif
+}
+
+// The position of the highest bit set, x must not be zero.
+inline constexpr unsigned floor_log2(std::uint64_t x) noexcept
+{
+#if defined(__GNUC__)
+  return 63 - static_cast<unsigned>(__builtin_clzll(x));
+#else
+  unsigned n = 0;
+  for (; x >>= 1;)
+    ++n;
+  return n;
+#endif
+}
+
+// A set of indexes kept as a hierarchy of bitmaps. Each bit of a
+// level tells whether the word below it has a bit set, up to a level
+// of a single word, so that the lowest index in the set is found
+// reading one word per level.
+class bit_tree {
+private:
+  std::vector<std::vector<std::uint64_t>> lv; // lv[0] has the indexes.
+  std::size_t n = 0;
+
+  static std::uint64_t bit(std::size_t i) noexcept
+  { return std::uint64_t(1) << (i % 64); }
+
+public:
+  std::size_t size() const noexcept { return n; }
+  bool empty() const noexcept { return lv.empty() || !lv.back()[0]; }
+
+  // Indexes past m are dropped, they must not be in the set.
+  void resize(std::size_t m);
+
+  bool test(std::size_t i) const noexcept
+  { return (lv[0][i / 64] & bit(i)) != 0; }
+
+  void set(std::size_t i) noexcept
+  {
+    for (auto& l : lv) {
+      const bool was_set = l[i / 64] != 0;
+      l[i / 64] |= bit(i);
+      if (was_set)
+        return;
+      i /= 64;
+    }
+  }
+
+  void reset(std::size_t i) noexcept
+  {
+    for (auto& l : lv) {
+      l[i / 64] &= ~bit(i);
+      if (l[i / 64])
+        return;
+      i /= 64;
+    }
+  }
+
+  // The lowest index in the set, size() if it is empty.
+  std::size_t find_first() const noexcept
+  {
+    if (empty())
+      return n;
+    std::size_t i = 0;
+    for (auto k = lv.size(); k-- > 0;)
+      i = i * 64 + count_trailing_zeros(lv[k][i]);
+    return i;
+  }
+};
+
+inline void bit_tree::resize(std::size_t m)
+{
+  n = m;
+  if (m == 0) {
+    lv.clear();
+    return;
+  }
+
+  std::size_t k = 0;
+  for (auto s = (m + 63) / 64;; s = (s + 63) / 64, ++k) {
+    if (k == lv.size()) {
+      // A new level on top of the last one.
+      lv.emplace_back(s, 0);
+      for (std::size_t i = 0; k != 0 && i < lv[k - 1].size(); ++i)
+        if (lv[k - 1][i])
+          lv[k][i / 64] |= bit(i);
+    } else {
+      lv[k].resize(s, 0);
+    }
+    if (s == 1)
+      break;
+  }
+  lv.resize(k + 1);
+}
+
+}
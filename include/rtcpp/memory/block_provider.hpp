@@ -0,0 +1,332 @@
+#pragma once
+
+#include <new>
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*
+  Sources of the blocks of node_storage. A provider hands out raw
+  memory aligned for any node type
+
+    void* allocate(std::size_t bytes);
+    void deallocate(void* p, std::size_t bytes) noexcept;
+
+  and is selected with the provider member of the storage policy.
+*/
+
+namespace rt {
+
+// The global operator new.
+struct new_provider {
+  void* allocate(std::size_t bytes) { return ::operator new(bytes); }
+  void deallocate(void* p, std::size_t) noexcept
+  { ::operator delete(p); }
+};
+
+// Blocks come from an upstream allocator, rebound to char.
+// node_allocator builds it from its own allocator.
+template <class A>
+class allocator_provider {
+private:
+  using alloc_type =
+    typename std::allocator_traits<A>::template rebind_alloc<char>;
+  using traits = std::allocator_traits<alloc_type>;
+  alloc_type alloc;
+public:
+  allocator_provider(const A& a = A()) : alloc(a) {}
+
+  void* allocate(std::size_t bytes)
+  { return traits::allocate(alloc, bytes); }
+  void deallocate(void* p, std::size_t bytes) noexcept
+  { traits::deallocate(alloc, static_cast<char*>(p), bytes); }
+};
+
+// A region of memory owned by the user where blocks are carved out
+// one after the other. Memory is given back only when the region
+// itself goes away.
+class arena {
+private:
+  char* buf;
+  std::size_t size;
+  std::size_t used = 0;
+public:
+  arena(void* p, std::size_t n) : buf(static_cast<char*>(p)), size(n) {}
+
+  void* allocate(std::size_t bytes)
+  {
+    constexpr auto a = alignof (std::max_align_t);
+    const auto begin = (used + a - 1) & ~(a - 1);
+    if (begin > size || size - begin < bytes)
+      throw std::bad_alloc();
+    used = begin + bytes;
+    return buf + begin;
+  }
+
+  std::size_t get_used() const noexcept { return used; }
+};
+
+class arena_provider {
+private:
+  arena* ar;
+public:
+  arena_provider(arena& a) : ar(&a) {}
+  void* allocate(std::size_t bytes) { return ar->allocate(bytes); }
+  void deallocate(void*, std::size_t) noexcept {}
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+
+enum mmap_flags : unsigned {
+  mmap_hugetlb = 1, // Explicit huge pages, see MAP_HUGETLB.
+  mmap_thp = 2, // Transparent huge pages, see MADV_HUGEPAGE.
+  mmap_populate = 4 // Prefaults the pages, see MAP_POPULATE.
+};
+
+// Anonymous private mappings. Blocks are rounded up to whole pages, so
+// the block size of the storage should be chosen accordingly. With
+// mmap_hugetlb the mapping falls back to normal pages when no huge
+// page is available. Flags not supported by the system are ignored.
+template <unsigned F = 0>
+class mmap_provider {
+private:
+  static constexpr std::size_t huge_page = std::size_t(1) << 21;
+  static constexpr std::size_t page = std::size_t(1) << 12;
+  static std::size_t round(std::size_t n, std::size_t a) noexcept
+  { return (n + a - 1) & ~(a - 1); }
+  static std::size_t length(std::size_t bytes) noexcept
+  {
+    const bool huge = (F & (mmap_hugetlb | mmap_thp)) != 0
+                   && bytes >= huge_page;
+    return round(bytes, huge ? huge_page : page);
+  }
+  static void* map(std::size_t n, int extra) noexcept
+  {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | extra;
+#ifdef MAP_POPULATE
+    if (F & mmap_populate)
+      flags |= MAP_POPULATE;
+#endif
+    void* p = ::mmap(nullptr, n, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return (p == MAP_FAILED) ? nullptr : p;
+  }
+public:
+  void* allocate(std::size_t bytes)
+  {
+    const auto n = length(bytes);
+    void* p = nullptr;
+#ifdef MAP_HUGETLB
+    if ((F & mmap_hugetlb) && n % huge_page == 0)
+      p = map(n, MAP_HUGETLB);
+#endif
+    if (!p)
+      p = map(n, 0);
+    if (!p)
+      throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if ((F & mmap_thp) && n % huge_page == 0)
+      ::madvise(p, n, MADV_HUGEPAGE);
+#endif
+    return p;
+  }
+
+  void deallocate(void* p, std::size_t bytes) noexcept
+  { ::munmap(p, length(bytes)); }
+};
+
+// Reserves a single range of addresses, without memory behind it,
+// where block k is committed in place at offset k times the block
+// size. The storage then finds a node from its index alone. It is
+// used with a policy whose contiguous member is true, see
+// contiguous_policy. The range is reserved when the first block is
+// committed, copies only keep its size.
+class vm_provider {
+private:
+  static constexpr std::size_t page = std::size_t(1) << 12;
+  std::size_t size;
+  char* base = nullptr;
+  void reserve()
+  {
+    void* p = ::mmap( nullptr, size, PROT_NONE
+                    , MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+                    , -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+    base = static_cast<char*>(p);
+  }
+  // Rounds an offset down and up to a page boundary.
+  static std::size_t first_page(std::size_t offset) noexcept
+  { return offset & ~(page - 1); }
+  static std::size_t last_page(std::size_t offset) noexcept
+  { return (offset + page - 1) & ~(page - 1); }
+public:
+  explicit vm_provider(std::size_t n = std::size_t(1) << 36)
+  : size(n & ~(page - 1))
+  {}
+  vm_provider(const vm_provider& other) : size(other.size) {}
+  vm_provider& operator=(const vm_provider&) = delete;
+  ~vm_provider() { if (base) ::munmap(base, size); }
+
+  char* data() const noexcept { return base; }
+
+  void* commit(std::size_t offset, std::size_t bytes)
+  {
+    if (offset + bytes > size)
+      throw std::bad_alloc();
+    if (!base)
+      reserve();
+    const auto a = first_page(offset);
+    const auto b = last_page(offset + bytes);
+    if (::mprotect(base + a, b - a, PROT_READ | PROT_WRITE) != 0)
+      throw std::bad_alloc();
+    return base + offset;
+  }
+
+  // Gives back the pages that lie entirely in the block.
+  void decommit(void* p, std::size_t bytes) noexcept
+  {
+    const auto offset = static_cast<std::size_t>(
+      static_cast<char*>(p) - base);
+    const auto a = last_page(offset);
+    const auto b = first_page(offset + bytes);
+    if (a < b) {
+      ::madvise(base + a, b - a, MADV_DONTNEED);
+      ::mprotect(base + a, b - a, PROT_NONE);
+    }
+  }
+};
+
+// How basic_file_provider opens its file and removes it.
+struct posix_file {
+  static int open(const char* path) noexcept
+  { return ::open(path, O_RDWR | O_CREAT, 0644); }
+  static int remove(const char* path) noexcept
+  { return ::unlink(path); }
+};
+
+// A POSIX shared memory object, named like "/name".
+struct posix_shm {
+  static int open(const char* name) noexcept
+  { return ::shm_open(name, O_RDWR | O_CREAT, 0644); }
+  static int remove(const char* name) noexcept
+  { return ::shm_unlink(name); }
+};
+
+// Like vm_provider, but the range maps a file, created if it does not
+// exist, that grows with the blocks committed. A header page before
+// the blocks is where a persistent storage keeps its state, see
+// persistent_policy. Copies only keep the path and the size.
+template <class F>
+class basic_file_provider {
+private:
+  static constexpr std::size_t page = std::size_t(1) << 12;
+  std::string path;
+  std::size_t size;
+  int fd = -1;
+  char* base = nullptr;
+  std::size_t file_size = 0;
+  void open();
+public:
+  static constexpr std::size_t header_size = page;
+
+  explicit basic_file_provider( std::string p
+                              , std::size_t n = std::size_t(1) << 36)
+  : path(std::move(p))
+  , size(n & ~(page - 1))
+  {}
+  basic_file_provider(const basic_file_provider& other)
+  : path(other.path)
+  , size(other.size)
+  {}
+  basic_file_provider& operator=(const basic_file_provider&) = delete;
+  ~basic_file_provider()
+  {
+    if (base)
+      ::munmap(base, header_size + size);
+    if (fd != -1)
+      ::close(fd);
+  }
+
+  // Removes the file, mappings of it stay valid.
+  static bool remove(const std::string& p) noexcept
+  { return F::remove(p.c_str()) == 0; }
+
+  // The header page, zero filled in a new file.
+  void* header()
+  {
+    if (!base)
+      open();
+    return base;
+  }
+
+  char* data() const noexcept { return base + header_size; }
+
+  void* commit(std::size_t offset, std::size_t bytes)
+  {
+    if (offset + bytes > size)
+      throw std::bad_alloc();
+    if (!base)
+      open();
+    const auto end = header_size + offset + bytes;
+    if (end > file_size) {
+      if (::ftruncate(fd, static_cast<off_t>(end)) != 0)
+        throw std::bad_alloc();
+      file_size = end;
+    }
+    return data() + offset;
+  }
+
+  // The pages stay in the file.
+  void decommit(void*, std::size_t) noexcept {}
+
+  // Writes the mapped pages back to the file.
+  void sync() noexcept
+  {
+    if (base)
+      ::msync(base, file_size, MS_SYNC);
+  }
+};
+
+template <class F>
+void basic_file_provider<F>::open()
+{
+  fd = F::open(path.c_str());
+  if (fd == -1)
+    throw std::system_error(errno, std::generic_category(), path);
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0)
+    throw std::system_error(errno, std::generic_category(), path);
+  file_size = static_cast<std::size_t>(st.st_size);
+  if (file_size < header_size) {
+    if (::ftruncate(fd, static_cast<off_t>(header_size)) != 0)
+      throw std::system_error(errno, std::generic_category(), path);
+    file_size = header_size;
+  }
+
+  void* p = ::mmap( nullptr, header_size + size
+                  , PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    throw std::bad_alloc();
+  base = static_cast<char*>(p);
+}
+
+using file_provider = basic_file_provider<posix_file>;
+
+// The blocks live in shared memory, where other processes can map
+// them, see shared_policy.
+using shm_provider = basic_file_provider<posix_shm>;
+
+#endif
+
+}
+
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace rt {
+
+// Defers the reuse of the nodes released to a storage S until no
+// reader can still see them. Readers announce the epoch they started
+// in and writers retire nodes in the bucket of the current epoch. The
+// epoch advances once every reader has seen it, at which point the
+// nodes retired two epochs before are given back to the storage, as
+// no reader that started before they were unlinked is left.
+template <class S>
+class epoch_domain {
+private:
+  using index_type = typename S::index_type;
+
+  // Where a reader announces its epoch, zero outside of reads. Slots
+  // are never freed before the domain, so writers walk them without
+  // locking, and are reused by later readers.
+  struct slot {
+    std::atomic<std::uint64_t> epoch {0};
+    std::atomic<bool> used {true};
+    slot* next = nullptr;
+  };
+
+  // Retirements between attempts to advance the epoch.
+  static constexpr std::size_t batch = 64;
+
+  std::atomic<std::uint64_t> global {1};
+  std::atomic<slot*> slots {nullptr};
+  std::mutex mtx; // Protects the buckets.
+  std::vector<index_type> retired[3];
+
+  slot* acquire_slot();
+  std::size_t advance(S& s);
+
+public:
+  // A thread that reads nodes writers may release. Reads happen
+  // between enter and leave, which may nest.
+  class reader {
+  private:
+    std::shared_ptr<epoch_domain> domain;
+    slot* s;
+    unsigned depth = 0;
+
+  public:
+    explicit reader(const std::shared_ptr<epoch_domain>& d)
+    : domain(d), s(d->acquire_slot()) {}
+    reader(reader&& other) noexcept
+    : domain(std::move(other.domain)), s(other.s), depth(other.depth)
+    { other.s = nullptr; }
+    reader(const reader&) = delete;
+    reader& operator=(const reader&) = delete;
+    ~reader()
+    {
+      if (s)
+        s->used.store(false, std::memory_order_release);
+    }
+
+    void enter() noexcept
+    {
+      if (depth++ != 0)
+        return;
+      const auto e = domain->global.load(std::memory_order_relaxed);
+      s->epoch.store(e, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void leave() noexcept
+    {
+      if (--depth == 0)
+        s->epoch.store(0, std::memory_order_release);
+    }
+  };
+
+  epoch_domain() = default;
+  epoch_domain(const epoch_domain&) = delete;
+  epoch_domain& operator=(const epoch_domain&) = delete;
+  ~epoch_domain()
+  {
+    for (auto p = slots.load(); p;) {
+      auto q = p->next;
+      delete p;
+      p = q;
+    }
+  }
+
+  // Puts i in the bucket of the current epoch. Every few calls the
+  // epoch is advanced if the readers allow it.
+  void retire(S& s, index_type i)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    const auto e = global.load(std::memory_order_relaxed);
+    auto& b = retired[e % 3];
+    b.push_back(i);
+    if (b.size() % batch == 0)
+      advance(s);
+  }
+
+  // Tries to advance the epoch and returns the number of nodes given
+  // back to the storage.
+  std::size_t reclaim(S& s)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    return advance(s);
+  }
+};
+
+template <class S>
+typename epoch_domain<S>::slot* epoch_domain<S>::acquire_slot()
+{
+  for (auto p = slots.load(std::memory_order_acquire); p; p = p->next) {
+    bool f = false;
+    if (p->used.compare_exchange_strong(f, true))
+      return p;
+  }
+
+  auto p = new slot;
+  p->next = slots.load(std::memory_order_relaxed);
+  while (!slots.compare_exchange_weak( p->next, p
+                                     , std::memory_order_release
+                                     , std::memory_order_relaxed))
+    ;
+  return p;
+}
+
+template <class S>
+std::size_t epoch_domain<S>::advance(S& s)
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const auto e = global.load(std::memory_order_relaxed);
+  for (auto p = slots.load(std::memory_order_acquire); p; p = p->next) {
+    const auto r = p->epoch.load(std::memory_order_seq_cst);
+    if (r != 0 && r != e)
+      return 0;
+  }
+  global.store(e + 1, std::memory_order_seq_cst);
+
+  // The bucket of epoch e - 1, which is also the one of e + 2.
+  auto& b = retired[(e + 2) % 3];
+  const auto n = b.size();
+  s.push(b.data(), n);
+  b.clear();
+  return n;
+}
+
+// Reads nodes for the lifetime of the guard.
+template <class R>
+class epoch_guard {
+private:
+  R& r;
+
+public:
+  explicit epoch_guard(R& rd) noexcept : r(rd) { r.enter(); }
+  epoch_guard(const epoch_guard&) = delete;
+  epoch_guard& operator=(const epoch_guard&) = delete;
+  ~epoch_guard() { r.leave(); }
+};
+
+}
+
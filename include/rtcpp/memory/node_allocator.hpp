@@ -2,20 +2,197 @@
 
 #include <memory>
 #include <vector>
+#include <cstddef>
 #include <utility>
+#include <algorithm>
 #include <exception>
 #include <type_traits>
 
 #include "node_traits.hpp"
 #include "node_storage.hpp"
+#include "epoch_domain.hpp"
+#include "storage_policy.hpp"
 
 namespace rt {
 
+// Per thread cache of free node indexes in front of a shared
+// node_storage. It is refilled and flushed in batches of half its
+// size. The storage is kept alive while the cache refers to it.
+template <class S, class I, std::size_t M>
+class magazine {
+  static_assert((M >= 2), "magazine: Size must be at least 2.");
+private:
+  std::shared_ptr<S> strg;
+  std::size_t n = 0;
+  I idx[M];
+
+  void bind(const std::shared_ptr<S>& s) noexcept
+  {
+    if (strg == s)
+      return;
+
+    if (strg)
+      strg->push(idx, n);
+
+    n = 0;
+    strg = s;
+  }
+
+public:
+  ~magazine() { bind(nullptr); }
+
+  static magazine& local()
+  {
+    static thread_local magazine m;
+    return m;
+  }
+
+  typename S::pointer pop(const std::shared_ptr<S>& s)
+  {
+    bind(s);
+    if (n == 0) {
+      n = strg->pop(idx, M / 2);
+      if (n == 0) // A fixed storage ran out.
+        return strg->pop();
+    }
+    return typename S::pointer(strg.get(), idx[--n]);
+  }
+
+  void push( const std::shared_ptr<S>& s
+           , typename S::pointer p) noexcept
+  {
+    bind(s);
+    if (n == M) {
+      strg->push(idx + M / 2, M / 2);
+      n = M / 2;
+    }
+    idx[n++] = p.get_link().get_idx();
+  }
+
+  void flush(const std::shared_ptr<S>& s) noexcept
+  {
+    if (strg == s)
+      bind(nullptr);
+  }
+};
+
+// Recycles the arrays node_allocator hands out besides nodes, in
+// size classes of powers of two from alignment bytes up to M. Each
+// class keeps a list of the arrays freed in it, linked through their
+// first bytes. New arrays are carved out of chunks taken from A,
+// which are only given back when the pool is destroyed.
+template <class A, std::size_t M, class Mutex>
+class array_pool {
+public:
+  static constexpr std::size_t alignment = alignof(std::max_align_t);
+  static constexpr std::size_t max_size = M;
+
+private:
+  static_assert((is_power_of_two<M>::value && M >= alignment),
+  "array_pool: M must be a power of 2 not less than the alignment.");
+
+  using char_allocator =
+    typename std::allocator_traits<A>::template rebind_alloc<char>;
+  using char_traits = std::allocator_traits<char_allocator>;
+
+  static constexpr std::size_t n_classes()
+  {
+    std::size_t k = 1;
+    for (auto s = alignment; s != M; s *= 2)
+      ++k;
+    return k;
+  }
+
+  // Holds at least 16 arrays of the largest class.
+  static constexpr std::size_t chunk_size =
+    std::max<std::size_t>(16 * M, 1 << 16);
+
+  char_allocator alloc;
+  Mutex mtx;
+  void* heads[n_classes()] = {}; // Free arrays of each class.
+  char* cur = nullptr; // What is left of the last chunk.
+  char* end = nullptr;
+  std::vector<char*> chunks;
+
+  static std::size_t size_class(std::size_t n) noexcept
+  {
+    std::size_t k = 0;
+    for (auto s = alignment; s < n; s *= 2)
+      ++k;
+    return k;
+  }
+
+  void push(std::size_t k, void* p) noexcept
+  {
+    *static_cast<void**>(p) = heads[k];
+    heads[k] = p;
+  }
+
+  void add_chunk();
+
+public:
+  explicit array_pool(const A& a = A()) : alloc(a) {}
+  array_pool(const array_pool&) = delete;
+  array_pool& operator=(const array_pool&) = delete;
+  ~array_pool()
+  {
+    for (auto p : chunks)
+      char_traits::deallocate(alloc, p, chunk_size);
+  }
+
+  // n is the size in bytes, at most M.
+  void* allocate(std::size_t n);
+  void deallocate(void* p, std::size_t n) noexcept
+  {
+    std::lock_guard<Mutex> lock(mtx);
+    push(size_class(n), p);
+  }
+};
+
+template <class A, std::size_t M, class Mutex>
+void* array_pool<A, M, Mutex>::allocate(std::size_t n)
+{
+  const auto k = size_class(n);
+  std::lock_guard<Mutex> lock(mtx);
+  if (void* p = heads[k]) {
+    heads[k] = *static_cast<void**>(p);
+    return p;
+  }
+
+  const auto s = alignment << k;
+  if (static_cast<std::size_t>(end - cur) < s)
+    add_chunk();
+  void* p = cur;
+  cur += s;
+  return p;
+}
+
+template <class A, std::size_t M, class Mutex>
+void array_pool<A, M, Mutex>::add_chunk()
+{
+  chunks.reserve(chunks.size() + 1);
+  auto p = char_traits::allocate(alloc, chunk_size);
+  chunks.push_back(p);
+
+  // The rest of the last chunk goes to the free lists. Arrays were
+  // carved from its start, so what is left is a multiple of the
+  // alignment.
+  for (auto k = n_classes(); k-- > 0;) {
+    const auto s = alignment << k;
+    for (; static_cast<std::size_t>(end - cur) >= s; cur += s)
+      push(k, cur);
+  }
+
+  cur = p;
+  end = p + chunk_size;
+}
+
 template < class T
          , class Node
          , class Index = std::size_t
          , std::size_t S = 256 // Block size.
          , class A = std::allocator<T>
+         , class P = storage_policy
          >
 class node_allocator {
   static_assert((is_power_of_two<S>::value),
@@ -24,13 +201,30 @@ class node_allocator {
   "node_allocator: Link type must be unsigned.");
   static_assert((S - 1 <= std::numeric_limits<Index>::max()),
   "node_allocator: Incompatible block size.");
+  static_assert((P::magazine == 0 || P::concurrent),
+  "node_allocator: Magazines need a concurrent storage.");
+  using has_magazine = std::integral_constant<bool, (P::magazine > 0)>;
+  using has_array_pool =
+    std::integral_constant<bool, (P::max_pooled > 0)>;
+  using has_epochs = std::integral_constant<bool, P::epochs>;
+  // A rebound to T, for the arrays that are not nodes.
+  using array_allocator =
+    typename std::allocator_traits<A>::template rebind_alloc<T>;
+  using array_traits = std::allocator_traits<array_allocator>;
 public:
   using link_type = node_link<Index>;
   using node_type =
     typename Node::template rebind< typename Node::value_type
                                   , link_type>;
 
-  using storage_type = node_storage<node_type, Index, S>;
+  using storage_type = node_storage<node_type, Index, S, P>;
+  using magazine_type = magazine<storage_type, Index, P::magazine>;
+  using array_pool_type =
+    array_pool< A, P::max_pooled
+              , typename if_type< P::concurrent, std::mutex
+                                , null_mutex>::type>;
+  using epoch_domain_type = epoch_domain<storage_type>;
+  using reader_type = typename epoch_domain_type::reader;
 
   using size_type =
     typename if_type< std::is_same<T, node_type>::value
@@ -39,29 +233,44 @@ public:
   using pointer =
     typename if_type< std::is_same<T, node_type>::value
                     , typename storage_type::pointer
-                    , typename A::pointer>::type;
+                    , typename array_traits::pointer>::type;
 
   using const_pointer =
     typename if_type< std::is_same<T, node_type>::value
                     , typename storage_type::const_pointer
-                    , typename A::const_pointer>::type;
+                    , typename array_traits::const_pointer>::type;
 
-  using reference = typename A::reference;
-  using const_reference = typename A::const_reference;
-  using value_type = typename A::value_type;
+  using reference = T&;
+  using const_reference = const T&;
+  using value_type = T;
 
   using iterator = typename storage_type::iterator;
   using const_iterator = typename storage_type::const_iterator;
 
   template<class U>
   struct rebind {
-    using other = node_allocator< U, Node, Index, S, A>;
+    using other = node_allocator< U, Node, Index, S, A, P>;
   };
 
+  using provider_type = typename storage_type::provider_type;
+
   std::shared_ptr<storage_type> header;
+  std::shared_ptr<array_pool_type> arrays; // Null if not pooled.
+  std::shared_ptr<epoch_domain_type> epochs; // Null without P::epochs.
   A alloc;
   node_allocator(const A& a = A())
-  : header(std::make_shared<storage_type>())
+  : header(std::make_shared<storage_type>(make_provider(a,
+      std::is_constructible<provider_type, const A&>())))
+  , arrays(make_array_pool(a, has_array_pool()))
+  , epochs(make_epoch_domain(has_epochs()))
+  , alloc(a)
+  {}
+
+  // For providers with state of their own, like an arena.
+  node_allocator(const provider_type& p, const A& a = A())
+  : header(std::make_shared<storage_type>(p))
+  , arrays(make_array_pool(a, has_array_pool()))
+  , epochs(make_epoch_domain(has_epochs()))
   , alloc(a)
   {}
 
@@ -71,8 +280,10 @@ public:
   auto end() { return header->end(); }
 
   template<class U, class V>
-  node_allocator(const node_allocator<U, V, Index, S, A>& a)
+  node_allocator(const node_allocator<U, V, Index, S, A, P>& a)
   : header(a.header)
+  , arrays(a.arrays)
+  , epochs(a.epochs)
   , alloc(a.alloc)
   {}
 
@@ -80,26 +291,126 @@ public:
   typename std::enable_if<
     !std::is_same<T2, node_type>::value, pointer>::type
   allocate(size_type n, const_pointer hint = 0)
-  { return alloc.allocate(n, hint); }
+  { return allocate_array(n, hint, has_array_pool()); }
 
   template <class T2 = T>
   typename std::enable_if<
     std::is_same<T2, node_type>::value, pointer>::type
-  allocate_node() { return header->pop(); }
+  allocate_node() { return allocate_node(has_magazine()); }
 
   template <class T2 = T>
   typename std::enable_if<
     !std::is_same<T2, node_type>::value>::type
   deallocate(pointer p, size_type n)
-  { return alloc.deallocate(p, n); }
+  { deallocate_array(p, n, has_array_pool()); }
 
   template <class T2 = T>
   typename std::enable_if<
     std::is_same<T2, node_type>::value>::type
   deallocate_node(pointer p)
-  { return header->push(p); }
+  {
+    if (P::epochs)
+      epochs->retire(*header, p.get_link().get_idx());
+    else
+      deallocate_node(p, has_magazine());
+  }
+
+  // Runs of nodes and chains are not offered with P::epochs, as
+  // linking released nodes writes on them while readers may still
+  // see them.
+  template <class T2 = T>
+  typename std::enable_if<
+    std::is_same<T2, node_type>::value && !P::epochs
+  , std::pair<pointer, pointer>>::type
+  allocate_nodes(std::size_t n) { return header->pop_n(n); }
+
+  template <class T2 = T>
+  typename std::enable_if<
+    std::is_same<T2, node_type>::value && !P::epochs>::type
+  link_node(pointer p, pointer next) noexcept
+  { header->link(p, next); }
+
+  template <class T2 = T>
+  typename std::enable_if<
+    std::is_same<T2, node_type>::value && !P::epochs>::type
+  deallocate_chain(pointer first, pointer last) noexcept
+  { header->push_chain(first, last); }
+
+  // A handle for a thread that reads nodes other threads release,
+  // see epoch_domain. Needs P::epochs.
+  reader_type reader() const { return reader_type(epochs); }
+
+  // Gives back to the storage the released nodes no reader can see
+  // anymore and returns how many. It also happens every few
+  // releases.
+  std::size_t reclaim() { return epochs->reclaim(*header); }
+
+  // Returns the nodes cached by the calling thread to the storage.
+  void flush() noexcept { flush(has_magazine()); }
+
+  // Releases the blocks of the storage that have no node in use,
+  // after flushing the cache of the calling thread. Nodes cached by
+  // other threads keep their blocks alive.
+  std::size_t shrink_to_fit()
+  {
+    flush();
+    return header->shrink_to_fit();
+  }
+
+  // Moves the nodes in use to the lowest slots of the storage, see
+  // node_storage::compact. Not offered with magazines or P::epochs,
+  // as the storage would take the nodes cached by threads or retired
+  // for being in use.
+  template <class F, class T2 = T>
+  typename std::enable_if<
+    std::is_same<T2, node_type>::value && P::magazine == 0
+    && !P::epochs, std::size_t>::type
+  compact(F f)
+  {
+    flush();
+    return header->compact(f);
+  }
+
+  // Whether nodes need not be released one by one: the storage never
+  // reuses them, or this is the last reference to it and the nodes go
+  // with it. A persistent storage keeps what it holds.
+  bool drops_nodes() const noexcept
+  { return P::monotonic || (!P::persistent && header.use_count() == 1); }
+
+  // Gives back all the blocks of the storage at once, after flushing
+  // the cache of the calling thread, see node_storage::release.
+  void release()
+  {
+    flush();
+    header->release();
+  }
+
+  // Makes the storage the one bound pointers refer to, see bind_mode.
+  void bind() noexcept { header->bind(); }
+
+  void reserve(std::size_t n) { header->reserve(n); }
+  std::size_t capacity() const { return header->capacity(); }
+
+  // The entry point of a persistent storage, see
+  // node_storage::get_root.
+  typename storage_type::pointer get_root() const
+  { return header->get_root(); }
+  void set_root(typename storage_type::pointer p)
+  { header->set_root(p); }
+
+  // Saves a persistent storage to its file.
+  void sync()
+  {
+    flush();
+    header->sync();
+  }
+
+  // A snapshot of the counters of the storage, see storage_stats.
+  storage_stats stats() const noexcept { return header->stats(); }
 
   std::size_t get_n_blocks() const { return header->get_n_blocks();}
+  std::size_t get_n_refills() const { return header->get_n_refills();}
+  std::size_t get_n_flushes() const { return header->get_n_flushes();}
 
   template<class U>
   void destroy(U* p) {p->~U();}
@@ -115,25 +426,92 @@ public:
 
   const_pointer address(const_reference x) const noexcept
   { return std::addressof(x); }
+
+private:
+  auto allocate_node(std::false_type) { return header->pop(); }
+  auto allocate_node(std::true_type)
+  { return magazine_type::local().pop(header); }
+
+  void deallocate_node(pointer p, std::false_type)
+  { header->push(p); }
+  void deallocate_node(pointer p, std::true_type)
+  { magazine_type::local().push(header, p); }
+
+  // Arrays of at most P::max_pooled bytes come from the pool, the
+  // others from A.
+  static bool is_pooled(size_type n) noexcept
+  {
+    return alignof(T) <= array_pool_type::alignment
+        && n <= P::max_pooled / sizeof (T);
+  }
+
+  pointer allocate_array( size_type n, const_pointer hint
+                        , std::false_type)
+  {
+    array_allocator a(alloc);
+    return array_traits::allocate(a, n, hint);
+  }
+  pointer allocate_array( size_type n, const_pointer hint
+                        , std::true_type)
+  {
+    if (!is_pooled(n))
+      return allocate_array(n, hint, std::false_type());
+    return static_cast<pointer>(arrays->allocate(n * sizeof (T)));
+  }
+
+  void deallocate_array(pointer p, size_type n, std::false_type)
+  {
+    array_allocator a(alloc);
+    array_traits::deallocate(a, p, n);
+  }
+  void deallocate_array(pointer p, size_type n, std::true_type)
+  {
+    if (!is_pooled(n))
+      return deallocate_array(p, n, std::false_type());
+    arrays->deallocate(p, n * sizeof (T));
+  }
+
+  static std::shared_ptr<array_pool_type>
+  make_array_pool(const A& a, std::true_type)
+  { return std::make_shared<array_pool_type>(a); }
+  static std::shared_ptr<array_pool_type>
+  make_array_pool(const A&, std::false_type) { return nullptr; }
+
+  static std::shared_ptr<epoch_domain_type>
+  make_epoch_domain(std::true_type)
+  { return std::make_shared<epoch_domain_type>(); }
+  static std::shared_ptr<epoch_domain_type>
+  make_epoch_domain(std::false_type) { return nullptr; }
+
+  static provider_type make_provider(const A& a, std::true_type)
+  { return provider_type(a); }
+  static provider_type make_provider(const A&, std::false_type)
+  { return provider_type(); }
+  void flush(std::false_type) noexcept {}
+  void flush(std::true_type) noexcept
+  { magazine_type::local().flush(header); }
 };
 
-template <class T, class V, class Index, std::size_t S, class A>
-bool operator==( const node_allocator<T, V, Index, S, A>& alloc1
-               , const node_allocator<T, V, Index, S, A>& alloc2)
+template < class T, class V, class Index, std::size_t S, class A
+         , class P>
+bool operator==( const node_allocator<T, V, Index, S, A, P>& alloc1
+               , const node_allocator<T, V, Index, S, A, P>& alloc2)
 {return alloc1.header == alloc2.header;}
 
-template <class T, class V, class Index, std::size_t S, class A>
-bool operator!=( const node_allocator<T, V, Index, S, A>& alloc1
-               , const node_allocator<T, V, Index, S, A>& alloc2)
+template < class T, class V, class Index, std::size_t S, class A
+         , class P>
+bool operator!=( const node_allocator<T, V, Index, S, A, P>& alloc1
+               , const node_allocator<T, V, Index, S, A, P>& alloc2)
 {return !(alloc1 == alloc2);}
 
 }
 
 namespace std {
 
-template <class T, class V, class Index, std::size_t S, class A>
-void swap( const rt::node_allocator<T, V, Index, S, A>& alloc1
-         , const rt::node_allocator<T, V, Index, S, A>& alloc2)
+template < class T, class V, class Index, std::size_t S, class A
+         , class P>
+void swap( const rt::node_allocator<T, V, Index, S, A, P>& alloc1
+         , const rt::node_allocator<T, V, Index, S, A, P>& alloc2)
 { alloc1.swap(alloc2); }
 
 }
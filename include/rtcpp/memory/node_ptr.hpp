@@ -2,6 +2,8 @@
 
 #include <type_traits>
 
+#include "storage_policy.hpp"
+
 // The following class obeys the requisite of a nullable
 // pointer type.
 
@@ -38,57 +40,84 @@ public:
 };
 
 //_______________________________________________________
-template <class, class, std::size_t>
+template <class, class, std::size_t, class>
 class node_storage;
 
-template <class T, class I, std::size_t N>
-class node_ptr {
+// The storage a node pointer refers to. Pointers to a bound storage
+// do not carry it, they look it up in the storage type.
+template <class S, bool Bound>
+class strg_ref {
+private:
+  S* m_strg;
+public:
+  strg_ref(S* p = nullptr) : m_strg(p) {}
+  S* get_strg() const noexcept { return m_strg; }
+  bool has_strg() const noexcept { return m_strg != nullptr; }
+  bool same_strg(const strg_ref& rhs) const noexcept
+  { return m_strg == rhs.m_strg; }
+};
+
+template <class S>
+class strg_ref<S, true> {
+public:
+  strg_ref(S* = nullptr) {}
+  S* get_strg() const noexcept { return S::get_bound(); }
+  bool has_strg() const noexcept { return true; }
+  bool same_strg(const strg_ref&) const noexcept { return true; }
+};
+
+template <class T, class I, std::size_t N, class P = storage_policy>
+class node_ptr
+  : private strg_ref<node_storage<T, I, N, P>, (P::binding != unbound)> {
 public:
   using index_type = I;
   using element_type = T;
   using link_type = node_link<I>;
   using difference_type = std::ptrdiff_t;
-  using strg_type = node_storage<T, I, N>;
-  template <class U> using rebind = node_ptr<U, I, N>;
+  using strg_type = node_storage<T, I, N, P>;
+  template <class U> using rebind = node_ptr<U, I, N, P>;
 
 private:
-  strg_type* m_strg;
+  using ref_type = strg_ref<strg_type, (P::binding != unbound)>;
   link_type m_link;
 
 public:
   node_ptr(std::nullptr_t p = nullptr)
-  : m_strg(nullptr), m_link (nullptr) {}
+  : ref_type(nullptr), m_link (nullptr) {}
 
-  node_ptr(strg_type* p, I i) : m_strg(p), m_link(i) {}
+  node_ptr(strg_type* p, I i) : ref_type(p), m_link(i) {}
 
   auto& operator=(const node_ptr& rhs)
-  { m_link = rhs.m_link; m_strg = rhs.m_strg; return *this; }
+  {
+    m_link = rhs.m_link;
+    static_cast<ref_type&>(*this) = rhs;
+    return *this;
+  }
 
   auto& operator=(const node_link<I>& rhs)
   { m_link = rhs; return *this; }
 
   auto get_link() const {return m_link;}
-  const auto* get_strg() const {return m_strg;}
+  const strg_type* get_strg() const {return ref_type::get_strg();}
 
   auto operator++() { ++m_link; return *this; }
   auto operator++(int)
   { auto tmp = *this; operator++; return tmp; }
 
-  explicit operator bool() const {return m_strg && m_link;}
+  explicit operator bool() const
+  {return ref_type::has_strg() && m_link;}
   operator link_type () const {return m_link;};
 
   auto* get_ptr()
   {
-    const auto b = m_strg->get_base_ptr(m_link.get_idx());
-    const auto raw_idx = strg_type::get_raw_idx(m_link.get_idx());
-    return reinterpret_cast<T*>(&b[raw_idx]);
+    const auto p = ref_type::get_strg()->get_ptr(m_link.get_idx());
+    return reinterpret_cast<T*>(p);
   }
 
   const auto* get_ptr() const
   {
-    const auto b = m_strg->get_base_ptr(m_link.get_idx());
-    const auto raw_idx = strg_type::get_raw_idx(m_link.get_idx());
-    return reinterpret_cast<const T*>(&b[raw_idx]);
+    const auto p = get_strg()->get_ptr(m_link.get_idx());
+    return reinterpret_cast<const T*>(p);
   }
 
   auto& operator*() { return *get_ptr(); }
@@ -98,7 +127,7 @@ public:
 
   friend
   auto operator==( const node_ptr& p1 , const node_ptr& p2)
-  { return p1.m_strg == p2.m_strg && p1.m_link  == p2.m_link; }
+  { return p1.same_strg(p2) && p1.m_link  == p2.m_link; }
 
   friend
   auto operator!=( const node_ptr& p1 , const node_ptr& p2)
@@ -106,41 +135,43 @@ public:
 };
 
 //____________________________________________________
-template <class T, class I, std::size_t N>
-class const_node_ptr {
+template <class T, class I, std::size_t N, class P = storage_policy>
+class const_node_ptr
+  : private strg_ref< const node_storage<T, I, N, P>
+                    , (P::binding != unbound)> {
 public:
   using index_type = I;
   using element_type = T;
   using link_type = node_link<I>;
   using difference_type = std::ptrdiff_t;
-  using strg_type = node_storage<T, I, N>;
-  template <class U> using rebind = const_node_ptr<U, I, N>;
+  using strg_type = node_storage<T, I, N, P>;
+  template <class U> using rebind = const_node_ptr<U, I, N, P>;
 
 private:
-  const strg_type* m_strg;
+  using ref_type = strg_ref<const strg_type, (P::binding != unbound)>;
   link_type m_link;
 
 public:
   const_node_ptr(std::nullptr_t p = nullptr)
-  : m_strg(nullptr), m_link(nullptr) {}
+  : ref_type(nullptr), m_link(nullptr) {}
 
   const_node_ptr(const strg_type* pp, I i)
-  : m_strg(pp), m_link(i) {}
+  : ref_type(pp), m_link(i) {}
 
-  const_node_ptr(const node_ptr<T, I, N>& pp)
-  : m_strg(pp.get_strg()), m_link(pp.get_link()) {}
+  const_node_ptr(const node_ptr<T, I, N, P>& pp)
+  : ref_type(pp.get_strg()), m_link(pp.get_link()) {}
 
   const auto* get_ptr() const
   {
-    const auto b = m_strg->get_base_ptr(m_link.get_idx());
-    const auto raw_idx = strg_type::get_raw_idx(m_link.get_idx());
-    return reinterpret_cast<const T*>(&b[raw_idx]);
+    const auto p = get_strg()->get_ptr(m_link.get_idx());
+    return reinterpret_cast<const T*>(p);
   }
 
   auto get_link() const {return m_link;}
-  const strg_type* get_strg() const {return m_strg;}
+  const strg_type* get_strg() const {return ref_type::get_strg();}
 
-  explicit operator bool() const {return m_strg && m_link;}
+  explicit operator bool() const
+  {return ref_type::has_strg() && m_link;}
   operator link_type () const {return m_link;};
   auto operator++() { ++m_link; return *this; }
   auto operator++(int)
@@ -154,7 +185,7 @@ public:
   friend
   auto operator==( const const_node_ptr& p1
                  , const const_node_ptr& p2)
-  {return p1.m_strg == p2.m_strg && p1.m_link == p2.m_link;}
+  {return p1.same_strg(p2) && p1.m_link == p2.m_link;}
 
   friend
   auto operator!=( const const_node_ptr& p1
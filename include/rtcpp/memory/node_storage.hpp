@@ -1,20 +1,227 @@
 #pragma once
 
 #include <array>
+#include <utility>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
 #include <vector>
 #include <limits>
 #include <memory>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
 #include <type_traits>
 
 #include "align.hpp"
+#include "bit_tree.hpp"
 #include "node_ptr.hpp"
+#include "node_traits.hpp"
+#include "storage_policy.hpp"
 
 namespace rt {
 
+struct null_mutex {
+  void lock() noexcept {}
+  void unlock() noexcept {}
+};
+
+// A table of blocks that never moves while it grows. Old tables are
+// kept until destruction so that concurrent readers do not see freed
+// memory.
+template <class I>
+class block_table {
+private:
+  std::atomic<I**> tbl {nullptr};
+  std::atomic<std::size_t> n {0};
+  std::size_t cap = 0;
+  std::vector<std::unique_ptr<I*[]>> tbls; // The last is the current.
+
+public:
+  std::size_t size() const noexcept
+  { return n.load(std::memory_order_acquire); }
+
+  I* operator[](std::size_t k) const noexcept
+  { return tbl.load(std::memory_order_acquire)[k]; }
+
+  I*& operator[](std::size_t k) noexcept
+  { return tbl.load(std::memory_order_acquire)[k]; }
+
+  I*& back() noexcept { return (*this)[size() - 1]; }
+  void pop_back() noexcept { n.fetch_sub(1, std::memory_order_release); }
+  void push_back(I* b);
+  void reserve(std::size_t c);
+};
+
+template <class I>
+void block_table<I>::reserve(std::size_t c)
+{
+  if (c <= cap)
+    return;
+
+  const auto s = n.load(std::memory_order_relaxed);
+  tbls.push_back(std::make_unique<I*[]>(c));
+  auto* t = tbls.back().get();
+  for (std::size_t i = 0; i < s; ++i)
+    t[i] = tbls[tbls.size() - 2][i];
+  cap = c;
+  tbl.store(t, std::memory_order_release);
+}
+
+template <class I>
+void block_table<I>::push_back(I* b)
+{
+  const auto s = n.load(std::memory_order_relaxed);
+  if (s == cap)
+    reserve((cap == 0) ? 8 : 2 * cap);
+  tbl.load(std::memory_order_relaxed)[s] = b;
+  n.store(s + 1, std::memory_order_release);
+}
+
+// A snapshot of the counters of a storage, see node_storage::stats.
+// Blocks and bytes are always filled, the rest only with
+// P::statistics.
+struct storage_stats {
+  std::size_t live = 0; // Nodes handed out and not given back.
+  std::size_t peak = 0; // Highest value of live so far.
+  std::size_t allocations = 0; // Nodes handed out.
+  std::size_t frees = 0; // Nodes given back.
+  std::size_t growths = 0; // Blocks added to the pool.
+  std::size_t blocks = 0; // Blocks held.
+  std::size_t bytes = 0; // Memory held by the blocks.
+};
+
+// The counters behind storage_stats, atomic for concurrent storages.
+// They are empty and cost nothing when disabled.
+template <bool Enabled, bool Atomic>
+class stats_counters {
+private:
+  using count_type =
+    typename if_type< Atomic, std::atomic<std::size_t>
+                    , std::size_t>::type;
+  count_type live {0};
+  count_type peak {0};
+  count_type allocs {0};
+  count_type frees {0};
+  count_type growths {0};
+
+  static void raise(std::size_t& c, std::size_t v) noexcept
+  { c = std::max(c, v); }
+  static void raise(std::atomic<std::size_t>& c, std::size_t v) noexcept
+  {
+    auto old = c.load(std::memory_order_relaxed);
+    while (old < v && !c.compare_exchange_weak( old, v
+                                              , std::memory_order_relaxed))
+      ;
+  }
+
+public:
+  void on_alloc(std::size_t n) noexcept
+  {
+    allocs += n;
+    raise(peak, live += n);
+  }
+
+  void on_free(std::size_t n) noexcept
+  {
+    frees += n;
+    live -= n;
+  }
+
+  void on_growth() noexcept { ++growths; }
+
+  void fill(storage_stats& s) const noexcept
+  {
+    s.live = live;
+    s.peak = peak;
+    s.allocations = allocs;
+    s.frees = frees;
+    s.growths = growths;
+  }
+};
+
+template <bool Atomic>
+class stats_counters<false, Atomic> {
+public:
+  void on_alloc(std::size_t) noexcept {}
+  void on_free(std::size_t) noexcept {}
+  void on_growth() noexcept {}
+  void fill(storage_stats&) const noexcept {}
+};
+
+// Visits the nodes in use of a storage in the order of their indexes,
+// scanning its occupancy bitmap a word at a time.
+template <class S, class Ptr>
+class live_iterator {
+private:
+  static constexpr auto N = S::block_nodes;
+  static constexpr auto W = S::bitmap_words;
+  S* strg;
+  std::size_t wi; // Current word of the bitmap.
+  std::uint64_t bits; // Its bits yet to be visited.
+
+  void skip() noexcept
+  {
+    while (bits == 0 && wi < strg->occ.size())
+      if (++wi < strg->occ.size())
+        bits = strg->occ[wi];
+  }
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = typename S::value_type;
+  using difference_type = std::ptrdiff_t;
+  using pointer = decltype(&*std::declval<Ptr>());
+  using reference = decltype(*std::declval<Ptr>());
+
+  live_iterator(S* s, std::size_t w) noexcept
+  : strg(s)
+  , wi(w)
+  , bits(w < s->occ.size() ? s->occ[w] : 0)
+  { skip(); }
+
+  auto get_idx() const noexcept
+  {
+    return static_cast<typename S::index_type>(
+      (wi / W) * N + (wi % W) * 64 + count_trailing_zeros(bits));
+  }
+
+  Ptr get_ptr() const noexcept { return Ptr(strg, get_idx()); }
+  reference operator*() const { return *get_ptr(); }
+  pointer operator->() const { return &*get_ptr(); }
+
+  live_iterator& operator++() noexcept
+  {
+    bits &= bits - 1;
+    skip();
+    return *this;
+  }
+
+  live_iterator operator++(int) noexcept
+  { auto tmp = *this; ++*this; return tmp; }
+
+  friend bool operator==( const live_iterator& a
+                        , const live_iterator& b) noexcept
+  { return a.wi == b.wi && a.bits == b.bits; }
+
+  friend bool operator!=( const live_iterator& a
+                        , const live_iterator& b) noexcept
+  { return !(a == b); }
+};
+
+template <class Iter>
+struct iter_range {
+  Iter first;
+  Iter last;
+  Iter begin() const { return first; }
+  Iter end() const { return last; }
+};
+
 template < class T // Node type.
          , class I // Index type.
          , std::size_t N // Number of blocks.
+         , class P = storage_policy
          >
 class node_storage {
   static_assert((!std::is_signed<I>::value),
@@ -25,75 +232,582 @@ class node_storage {
   "node_storage: N must be a power of 2.");
   static_assert((N >= 2),
   "node_storage: Number of blocks must be at least 2.");
+  static_assert((!P::concurrent || sizeof (I) <= 4),
+  "node_storage: Concurrent mode needs at most 32 bits indexes.");
+  static_assert((!P::concurrent || !P::occupancy),
+  "node_storage: The occupancy bitmap needs a single threaded storage.");
+  static_assert((!P::concurrent || !P::address_ordered),
+  "node_storage: Address ordering needs a single threaded storage.");
+  static_assert((!P::persistent || (P::contiguous && !P::concurrent
+                 && !P::occupancy && !P::address_ordered
+                 && !P::geometric)),
+  "node_storage: Incompatible persistent policy.");
+  static_assert((!P::monotonic || !P::address_ordered),
+  "node_storage: A monotonic storage has no free nodes to order.");
+  static_assert((!P::geometric || !P::occupancy || N % 64 == 0),
+  "node_storage: Geometric blocks need N multiple of 64 for the bitmap.");
+  template <class, class> friend class live_iterator;
 private:
   static constexpr auto SL = sizeof (I);
   static constexpr auto ST = sizeof (T);
   // Block size in units of link type size.
   static constexpr auto R = (SL < ST) ? ST / SL : 1;
-  I free {0}; // I of the next free node.
-  std::vector<std::unique_ptr<I[]>> bufs;
-  I add_bloc(); // returns the I of the next free node.
+  static constexpr auto log_N = floor_log2(N);
+  using is_concurrent = std::integral_constant<bool, P::concurrent>;
+  using is_contiguous = std::integral_constant<bool, P::contiguous>;
+  using binding = std::integral_constant<bind_mode, P::binding>;
+  using is_persistent = std::integral_constant<bool, P::persistent>;
+  // What a persistent storage keeps in the header of its file.
+  struct file_state {
+    std::uint64_t magic;
+    std::uint64_t layout[3]; // Sizes of a node, a block and an index.
+    std::uint64_t blocks;
+    std::uint64_t free;
+    std::uint64_t fresh[2];
+    std::uint64_t root;
+  };
+  static constexpr std::uint64_t file_magic = 0x72746370705f6e73;
+  // In concurrent mode the index of the next free node is packed
+  // with a generation tag in the high 32 bits to avoid ABA.
+  using free_type =
+    typename if_type< P::concurrent
+                    , std::atomic<std::uint64_t>, I>::type;
+  // The nodes of the last block added that were never handed out,
+  // as the first of them and how many there are. They are not linked
+  // in the free list, so growing costs O(1). In concurrent mode both
+  // are packed in one word, the count in the low 32 bits.
+  using fresh_type =
+    typename if_type< P::concurrent
+                    , std::atomic<std::uint64_t>, std::pair<I, I>>::type;
+  using table_type =
+    typename if_type< P::concurrent
+                    , block_table<I>, std::vector<I*>>::type;
+  using mutex_type =
+    typename if_type<P::concurrent, std::mutex, null_mutex>::type;
+  free_type free {0}; // I of the next free node.
+  fresh_type fresh {};
+  table_type bufs;
+  mutex_type mtx; // Protects the growth of the pool.
+  typename P::provider prov;
+  std::atomic<std::size_t> refills {0}; // Calls to pop(out, n).
+  std::atomic<std::size_t> flushes {0}; // Calls to push(in, n).
+  stats_counters<P::statistics, P::concurrent> counters;
+  I root = 0; // See get_root.
+  // The state last loaded or saved. A storage that did not change it
+  // leaves the file alone, so that processes that only read do not
+  // overwrite what another one wrote meanwhile.
+  file_state saved {};
+  std::vector<std::size_t> holes; // Released blocks, lowest last.
+  // A bit per node telling whether it is in use, bitmap_words words
+  // per block. Only kept with P::occupancy.
+  std::vector<std::uint64_t> occ;
+  // The free nodes with P::address_ordered, that replace the free list
+  // and the fresh range so that the lowest is handed out first.
+  bit_tree free_bits;
+  bool has_free() const noexcept
+  {
+    if (P::address_ordered)
+      return !free_bits.empty();
+    return static_cast<I>(free) != 0;
+  }
+  void set_in_use(I i, bool b) noexcept
+  {
+    auto& w = occ[(i / N) * bitmap_words + (i % N) / 64];
+    const auto m = std::uint64_t(1) << (i % N % 64);
+    w = b ? (w | m) : (w & ~m);
+  }
+  // The block of index i and the index block k starts at. Blocks
+  // hold N nodes, or N << k with P::geometric, in which case the block
+  // is found from the highest bit of i + N.
+  static constexpr std::size_t block_of(std::size_t i) noexcept
+  { return P::geometric ? floor_log2(i + N) - log_N : i / N; }
+  static constexpr std::size_t block_begin(std::size_t k) noexcept
+  { return P::geometric ? (N << k) - N : k * N; }
+  static constexpr std::size_t bloc_bytes(std::size_t k) noexcept
+  { return (block_begin(k + 1) - block_begin(k)) * R * SL; }
+  // Nodes the blocks held can hold, the null node included.
+  std::size_t held_nodes() const noexcept
+  {
+    auto n = block_begin(bufs.size());
+    for (auto k : holes)
+      n -= block_begin(k + 1) - block_begin(k);
+    return n;
+  }
+  std::size_t add_bloc(); // Returns the block number.
+  I* alloc_bloc(std::size_t k, std::false_type)
+  { return static_cast<I*>(prov.allocate(bloc_bytes(k))); }
+  I* alloc_bloc(std::size_t k, std::true_type)
+  {
+    return static_cast<I*>(
+      prov.commit(block_begin(k) * R * SL, bloc_bytes(k)));
+  }
+  void free_bloc(I* b, std::size_t k, std::false_type) noexcept
+  { prov.deallocate(b, bloc_bytes(k)); }
+  void free_bloc(I* b, std::size_t k, std::true_type) noexcept
+  { prov.decommit(b, bloc_bytes(k)); }
+  void link_bloc(std::size_t k);
+  void grow();
+  bool is_valid(I i) const noexcept
+  { return i < block_begin(bufs.size()) && bufs[block_of(i)]; }
+  T* node_at(I i) noexcept
+  { return reinterpret_cast<T*>(get_ptr(i)); }
+  // First and last node of block k. Index 0 is the null node.
+  static I first_node(std::size_t k) noexcept
+  { return static_cast<I>(block_begin(k) + ((k == 0) ? 1 : 0)); }
+  static I last_node(std::size_t k) noexcept
+  { return static_cast<I>(block_begin(k + 1) - 1); }
+  static std::uint64_t pack(I i, std::uint64_t old) noexcept
+  { return (((old >> 32) + 1) << 32) | i; }
   node_storage& operator=(const node_storage&) = delete;
   node_storage(const node_storage&) = delete;
   void swap(node_storage& other);
 public:
-  using pointer = node_ptr<T, I, N>;
-  using const_pointer = const_node_ptr<T, I, N>;
+  static constexpr auto block_nodes = N;
+  static constexpr std::size_t bitmap_words = (N + 63) / 64;
+  using index_type = I;
+  using pointer = node_ptr<T, I, N, P>;
+  using const_pointer = const_node_ptr<T, I, N, P>;
+  using provider_type = typename P::provider;
   using void_pointer = void_node_ptr<I>;
   using const_void_pointer = const_void_node_ptr<I>;
   using link_type = node_link<I>;
   using value_type = T;
   using const_iterator = const_pointer;
   using iterator = pointer;
+  using live_iterator = rt::live_iterator<node_storage, pointer>;
+  using const_live_iterator =
+    rt::live_iterator<const node_storage, const_pointer>;
 
   auto begin() const { return const_pointer(this, 1); }
   auto end() const
   {
     return
       const_pointer( this
-                   , static_cast<I>(get_n_blocks() * N));
+                   , static_cast<I>(block_begin(get_n_blocks())));
   }
 
   auto begin() { return pointer(this, 1); }
   auto end()
   {
-    return pointer(this, static_cast<I>(get_n_blocks() * N));
+    return pointer(this, static_cast<I>(block_begin(get_n_blocks())));
   }
 
-  node_storage() {}
+  explicit node_storage(const provider_type& p = provider_type())
+  : prov(p)
+  {
+    load(is_persistent());
+    if (!get_bound())
+      bind();
+  }
+  ~node_storage();
+
+  // The storage of bound pointers, see bind_mode. The constructor
+  // sets it only when none is, another storage takes over with bind.
+  static node_storage* get_bound() noexcept
+  { return bound_slot(binding()); }
+  void bind() noexcept { bind(binding()); }
+
   std::size_t get_n_blocks() const {return bufs.size();}
-  I* get_base_ptr(I idx) { return bufs[idx / N].get(); }
-  const I* get_base_ptr(I idx) const { return bufs[idx / N].get(); }
+
+  // The node through which a persistent storage is found again, null
+  // if none was set.
+  pointer get_root() const noexcept
+  { return pointer(const_cast<node_storage*>(this), root); }
+  void set_root(pointer p) noexcept
+  {
+    static_assert(P::persistent, "node_storage: Not persistent.");
+    root = p.get_link().get_idx();
+  }
+
+  // Saves the state of a persistent storage and writes it back to
+  // its file with the nodes. It is otherwise saved on destruction.
+  void sync()
+  {
+    save(is_persistent());
+    prov.sync();
+  }
+
+  // Number of nodes the blocks in use can hold.
+  std::size_t capacity() const noexcept
+  {
+    if (bufs.size() == 0)
+      return 0;
+    return held_nodes() - (bufs[0] ? 1 : 0);
+  }
+
+  static constexpr std::size_t max_size() noexcept
+  { return std::numeric_limits<I>::max(); }
+
+  // Grows the pool until it can hold n nodes, so that no allocation
+  // happens while they are in use. It is the only way a fixed storage
+  // grows.
+  void reserve(std::size_t n);
+  I* get_base_ptr(I idx)
+  { return const_cast<I*>(get_base_ptr(idx, is_contiguous())); }
+  const I* get_base_ptr(I idx) const
+  { return get_base_ptr(idx, is_contiguous()); }
 
   static constexpr std::size_t get_raw_idx(I idx)
-  {return (idx & (N - 1)) * R;}
+  {return (idx - block_begin(block_of(idx))) * R;}
+
+  // The first word of the node idx. A contiguous storage finds it
+  // from the index alone, without going through its block.
+  I* get_ptr(I idx)
+  { return const_cast<I*>(get_ptr(idx, is_contiguous())); }
+  const I* get_ptr(I idx) const
+  { return get_ptr(idx, is_contiguous()); }
+
+  pointer pop()
+  {
+    auto p = pop(is_concurrent());
+    if (p) {
+      if (P::occupancy)
+        set_in_use(p.get_link().get_idx(), true);
+      counters.on_alloc(1);
+    }
+    return p;
+  }
+
+  void push(pointer idx) noexcept
+  {
+    if (P::occupancy)
+      set_in_use(idx.get_link().get_idx(), false);
+    counters.on_free(1);
+    if (!P::monotonic)
+      push(idx, is_concurrent());
+  }
+
+  // The nodes in use, in the order they lie in memory. Needs
+  // P::occupancy.
+  iter_range<live_iterator> live() noexcept
+  { return {live_iterator(this, 0), live_iterator(this, occ.size())}; }
+  iter_range<const_live_iterator> live() const noexcept
+  {
+    return { const_live_iterator(this, 0)
+           , const_live_iterator(this, occ.size())};
+  }
 
-  pointer pop();
-  void push(pointer idx) noexcept;
+  bool in_use(I i) const noexcept
+  {
+    const auto w = occ[(i / N) * bitmap_words + (i % N) / 64];
+    return (w >> (i % N % 64)) & 1;
+  }
+
+  // Batch versions of pop and push, used by per thread caches. They
+  // exchange n indexes with the free list at once. Fewer nodes are
+  // popped only when a fixed storage runs out.
+  std::size_t pop(I* out, std::size_t n)
+  {
+    refills.fetch_add(1, std::memory_order_relaxed);
+    return pop(out, n, is_concurrent());
+  }
+
+  void push(const I* in, std::size_t n) noexcept
+  {
+    if (n == 0)
+      return;
+    flushes.fetch_add(1, std::memory_order_relaxed);
+    if (P::monotonic) {
+      for (std::size_t k = 0; P::occupancy && k < n; ++k)
+        set_in_use(in[k], false);
+      counters.on_free(n);
+      return;
+    }
+    push(in, n, is_concurrent());
+  }
+
+  // Returns a run [first, last) of at most n adjacent nodes carved
+  // out of a new block, the rest of which goes to the free list. To
+  // avoid growing the pool needlessly, the run has a single node
+  // while the free list is not empty. With P::address_ordered the
+  // run starts at the lowest free node instead.
+  std::pair<pointer, pointer> pop_n(std::size_t n);
+
+  // Makes next the successor of p in a chain of nodes that is
+  // released with push_chain.
+  void link(pointer p, pointer next) noexcept
+  {
+    store_link(p.get_link().get_idx(), next.get_link().get_idx());
+  }
+
+  // Splices the chain first -> ... -> last in the free list in O(1),
+  // or in the length of the chain with P::occupancy or
+  // P::statistics.
+  void push_chain(pointer first, pointer last) noexcept
+  {
+    const auto i = first.get_link().get_idx();
+    const auto j = last.get_link().get_idx();
+    if (P::occupancy || P::statistics) {
+      std::size_t n = 1;
+      for (auto k = i; k != j; k = get_base_ptr(k)[get_raw_idx(k)], ++n)
+        if (P::occupancy)
+          set_in_use(k, false);
+      if (P::occupancy)
+        set_in_use(j, false);
+      counters.on_free(n);
+    }
+    if (!P::monotonic)
+      push_chain(i, j, is_concurrent());
+  }
+
+  // Releases the blocks that have no node in use and returns how
+  // many were released. Their nodes are unlinked from the free list
+  // and the slots they leave in the block table are reused when the
+  // pool grows again. The per block counts of free nodes are taken
+  // from a walk of the free list, so that pop and push pay nothing
+  // for it. Iterating from begin() to end() is not valid afterwards.
+  // In concurrent mode no other thread may use the storage meanwhile.
+  std::size_t shrink_to_fit();
+
+  // Moves the nodes in use to the lowest free slots, so that they fit
+  // in fewer blocks, and releases the blocks left empty, see
+  // shrink_to_fit. The links the nodes hold are fixed by the caller:
+  // f(from, to, fwd) is called for each node in use, where to is its
+  // new place (from if it did not move, from must not be
+  // dereferenced) and fwd maps a link_type to its new value. Hence
+  // all nodes in use must belong to the caller. Returns the number of
+  // nodes moved. Not available with magazines or epochs, whose nodes
+  // out of the free list are not all in use.
+  template <class F>
+  std::size_t compact(F f);
+
+  // Gives back all the blocks at once, in the number of blocks, as if
+  // every node had been released and then shrink_to_fit called. The
+  // nodes in use are lost without their destructors being called. In
+  // concurrent mode no other thread may use the storage meanwhile.
+  void release() noexcept;
+
+  // Blocks and bytes held, and the counters kept with P::statistics.
+  // Nodes in the caches of node_allocator count as live.
+  storage_stats stats() const noexcept
+  {
+    storage_stats s;
+    counters.fill(s);
+    s.blocks = bufs.size() - holes.size();
+    s.bytes = held_nodes() * R * SL;
+    return s;
+  }
+
+  std::size_t get_n_refills() const noexcept
+  { return refills.load(std::memory_order_relaxed); }
+  std::size_t get_n_flushes() const noexcept
+  { return flushes.load(std::memory_order_relaxed); }
 
   bool operator==(const node_storage& rhs) const noexcept
-  {return bufs == rhs.bufs;}
+  {return this == &rhs;}
+
+private:
+  // The link of the free node i. In concurrent mode a thread popping
+  // may still read it after another one took the node and wrote on
+  // it, see pop, so links are read and written atomically.
+  I load_link(I i) const noexcept
+  { return load_link(get_ptr(i), is_concurrent()); }
+  void store_link(I i, I next) noexcept
+  { store_link(get_ptr(i), next, is_concurrent()); }
+  static I load_link(const I* p, std::false_type) noexcept
+  { return *p; }
+  static void store_link(I* p, I next, std::false_type) noexcept
+  { *p = next; }
+  static I load_link(const I* p, std::true_type) noexcept
+  {
+#if defined(__GNUC__)
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+#else
+    return *p;
+#endif
+  }
+  static void store_link(I* p, I next, std::true_type) noexcept
+  {
+#if defined(__GNUC__)
+    __atomic_store_n(p, next, __ATOMIC_RELAXED);
+#else
+    *p = next;
+#endif
+  }
+  pointer pop(std::false_type);
+  pointer pop(std::true_type);
+  std::pair<I, I> take_lowest(std::size_t n);
+  // Records that the run [first, last) was handed out.
+  void on_taken(I first, I last) noexcept
+  {
+    if (P::occupancy)
+      for (auto i = first; i != last; ++i)
+        set_in_use(i, true);
+    counters.on_alloc(last - first);
+  }
+  void push(pointer idx, std::false_type) noexcept;
+  void push(pointer idx, std::true_type) noexcept;
+  std::size_t pop(I* out, std::size_t n, std::false_type);
+  std::size_t pop(I* out, std::size_t n, std::true_type);
+  pointer exhausted()
+  {
+    P::exhausted();
+    return pointer();
+  }
+  void push(const I* in, std::size_t n, std::false_type) noexcept;
+  void push(const I* in, std::size_t n, std::true_type) noexcept;
+  void push_chain(I first, I last, std::false_type) noexcept;
+  void push_chain(I first, I last, std::true_type) noexcept;
+  const I* get_base_ptr(I idx, std::false_type) const noexcept
+  { return bufs[block_of(idx)]; }
+  const I* get_base_ptr(I idx, std::true_type) const noexcept
+  {
+    return reinterpret_cast<const I*>(prov.data())
+         + block_begin(block_of(idx)) * R;
+  }
+  const I* get_ptr(I idx, std::false_type) const noexcept
+  { return get_base_ptr(idx, std::false_type()) + get_raw_idx(idx); }
+  const I* get_ptr(I idx, std::true_type) const noexcept
+  {
+    return reinterpret_cast<const I*>(prov.data())
+         + static_cast<std::size_t>(idx) * R;
+  }
+  template <bind_mode B>
+  static node_storage*
+  bound_slot(std::integral_constant<bind_mode, B>) noexcept
+  { return nullptr; }
+  static node_storage*&
+  bound_slot(std::integral_constant<bind_mode, process_bound>) noexcept
+  {
+    static node_storage* p = nullptr;
+    return p;
+  }
+  static node_storage*&
+  bound_slot(std::integral_constant<bind_mode, thread_bound>) noexcept
+  {
+    static thread_local node_storage* p = nullptr;
+    return p;
+  }
+  void load(std::false_type) noexcept {}
+  void load(std::true_type);
+  void save(std::false_type) noexcept {}
+  void save(std::true_type) noexcept;
+  void bind(std::integral_constant<bind_mode, unbound>) noexcept {}
+  template <bind_mode B>
+  void bind(std::integral_constant<bind_mode, B> b) noexcept
+  { bound_slot(b) = this; }
+  void unbind(std::integral_constant<bind_mode, unbound>) noexcept {}
+  template <bind_mode B>
+  void unbind(std::integral_constant<bind_mode, B> b) noexcept
+  {
+    if (bound_slot(b) == this)
+      bound_slot(b) = nullptr;
+  }
+  // Takes at most n fresh nodes and returns them as [first, last).
+  std::pair<I, I> take(std::size_t n, std::false_type) noexcept;
+  std::pair<I, I> take(std::size_t n, std::true_type) noexcept;
+  std::pair<I, I> get_fresh(std::false_type) const noexcept
+  { return fresh; }
+  std::pair<I, I> get_fresh(std::true_type) const noexcept
+  {
+    const auto f = fresh.load(std::memory_order_acquire);
+    return std::make_pair( static_cast<I>(f >> 32)
+                         , static_cast<I>(f & 0xffffffff));
+  }
+  void set_fresh(I i, I n, std::false_type) noexcept
+  { fresh = std::make_pair(i, n); }
+  void set_fresh(I i, I n, std::true_type) noexcept
+  {
+    fresh.store( (static_cast<std::uint64_t>(i) << 32) | n
+               , std::memory_order_release);
+  }
+  void set_free(I i, std::false_type) noexcept { free = i; }
+  void set_free(I i, std::true_type) noexcept
+  { free.store(pack(i, free.load()), std::memory_order_release); }
 };
 
-template < class T, class I, std::size_t N>
-void node_storage<T, I, N>::push(pointer idx) noexcept
+template <class T, class I, std::size_t N, class P>
+node_storage<T, I, N, P>::~node_storage()
+{
+  unbind(binding());
+  save(is_persistent());
+
+  for (std::size_t k = 0; k < bufs.size(); ++k)
+    if (bufs[k])
+      free_bloc(bufs[k], k, is_contiguous());
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::load(std::true_type)
+{
+  const auto* h = static_cast<const file_state*>(prov.header());
+  const std::uint64_t layout[] = {ST, N, SL};
+  saved = *h;
+  if (h->magic == 0) // A new file.
+    return;
+  if (h->magic != file_magic || !std::equal(layout, layout + 3, h->layout))
+    throw std::runtime_error("node_storage: Incompatible file.");
+
+  bufs.reserve(h->blocks);
+  for (std::size_t k = 0; k < h->blocks; ++k)
+    bufs.push_back(alloc_bloc(k, is_contiguous()));
+  free = static_cast<I>(h->free);
+  fresh = std::make_pair( static_cast<I>(h->fresh[0])
+                        , static_cast<I>(h->fresh[1]));
+  root = static_cast<I>(h->root);
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::save(std::true_type) noexcept
+{
+  const file_state s { file_magic, {ST, N, SL}, bufs.size(), free
+                     , {fresh.first, fresh.second}, root};
+  if (std::memcmp(&s, &saved, sizeof s) != 0) {
+    *static_cast<file_state*>(prov.header()) = s;
+    saved = s;
+  }
+}
+
+template <class T, class I, std::size_t N, class P>
+void
+node_storage<T, I, N, P>::push(pointer idx, std::false_type) noexcept
 {
   assert(idx.get_strg() == this);
   const auto i = idx.get_link().get_idx();
+  if (P::address_ordered) {
+    free_bits.set(i);
+    return;
+  }
   auto b = get_base_ptr(i);
   b[get_raw_idx(i)] = free;
   free = i;
 }
 
-template <class T, class I, std::size_t N>
-typename node_storage<T, I, N>::pointer
-node_storage<T, I, N>::pop()
+template <class T, class I, std::size_t N, class P>
+void
+node_storage<T, I, N, P>::push(pointer idx, std::true_type) noexcept
+{
+  assert(idx.get_strg() == this);
+  const auto i = idx.get_link().get_idx();
+  auto h = free.load(std::memory_order_relaxed);
+  do {
+    store_link(i, static_cast<I>(h));
+  } while (!free.compare_exchange_weak( h, pack(i, h)
+                                      , std::memory_order_release
+                                      , std::memory_order_relaxed));
+}
+
+template <class T, class I, std::size_t N, class P>
+typename node_storage<T, I, N, P>::pointer
+node_storage<T, I, N, P>::pop(std::false_type)
 {
-  auto i = free;
+  if (P::address_ordered) {
+    const auto r = take_lowest(1);
+    if (r.first == r.second)
+      return exhausted();
+    return pointer(this, r.first);
+  }
 
+  const auto i = free;
   if (!i) {
-    free = add_bloc();
-    i = free;
+    if (P::fixed)
+      return exhausted();
+    auto r = take(1, std::false_type());
+    if (r.first == r.second) {
+      grow();
+      r = take(1, std::false_type());
+    }
+    return pointer(this, r.first);
   }
 
   const auto b = get_base_ptr(i);
@@ -101,21 +815,480 @@ node_storage<T, I, N>::pop()
   return pointer(this, i);
 }
 
-template <class T, class I, std::size_t N>
-I node_storage<T, I, N>::add_bloc()
+// Takes the lowest free node and those that follow it in the same
+// block, at most n, as [first, last). The range is empty only when a
+// fixed storage runs out.
+template <class T, class I, std::size_t N, class P>
+std::pair<I, I> node_storage<T, I, N, P>::take_lowest(std::size_t n)
+{
+  auto i = free_bits.find_first();
+  if (i == free_bits.size()) {
+    if (P::fixed)
+      return std::make_pair(I(0), I(0));
+    grow();
+    i = free_bits.find_first();
+  }
+
+  const auto e = block_begin(block_of(i) + 1);
+  auto j = i;
+  do {
+    free_bits.reset(j++);
+  } while (j - i < n && j != e && free_bits.test(j));
+  return std::make_pair(static_cast<I>(i), static_cast<I>(j));
+}
+
+template <class T, class I, std::size_t N, class P>
+typename node_storage<T, I, N, P>::pointer
+node_storage<T, I, N, P>::pop(std::true_type)
 {
-    // Add a check to test if the link type is big
-    // enough to grow the node pool.
-    const auto size = bufs.size();
-    bufs.push_back(std::make_unique<I[]>(N * R));
-    const auto offset = size * N;
-    for (std::size_t i = 0; i < N - 1; ++i)
-      bufs.back()[i * R] = static_cast<I>(offset + i + 1);
+  auto h = free.load(std::memory_order_acquire);
+  for (;;) {
+    const auto i = static_cast<I>(h);
+    if (!i) {
+      if (P::fixed)
+        return exhausted();
+      const auto r = take(1, std::true_type());
+      if (r.first != r.second)
+        return pointer(this, r.first);
+      grow();
+      h = free.load(std::memory_order_acquire);
+      continue;
+    }
 
-    bufs.back()[N - 1] = 0;
-    return (size == 0) ? static_cast<I>(1) 
-                       : static_cast<I>(size * N);
+    // The node may be taken by another thread while we read its
+    // link, in which case the tag has changed and the exchange fails.
+    // The read itself is atomic, as that thread may write on it.
+    const auto next = load_link(i);
+    if (free.compare_exchange_weak( h, pack(next, h)
+                                  , std::memory_order_acquire
+                                  , std::memory_order_acquire))
+      return pointer(this, i);
+  }
 }
 
-} // rt
+template <class T, class I, std::size_t N, class P>
+std::size_t
+node_storage<T, I, N, P>::pop(I* out, std::size_t n, std::false_type)
+{
+  for (std::size_t k = 0; k < n; ++k) {
+    if (P::fixed && !has_free())
+      return k;
+    out[k] = pop().get_link().get_idx();
+  }
+  return n;
+}
+
+template <class T, class I, std::size_t N, class P>
+std::size_t
+node_storage<T, I, N, P>::pop(I* out, std::size_t n, std::true_type)
+{
+  const auto n0 = n;
+  auto h = free.load(std::memory_order_acquire);
+  while (n != 0) {
+    auto i = static_cast<I>(h);
+    if (!i) {
+      if (P::fixed)
+        break;
+      const auto r = take(n, std::true_type());
+      for (auto j = r.first; j != r.second; ++j)
+        *out++ = j;
+      n -= r.second - r.first;
+      if (r.first == r.second)
+        grow();
+      h = free.load(std::memory_order_acquire);
+      continue;
+    }
+
+    // Walks at most n nodes. The links read may be stale if other
+    // threads pop concurrently, so they are checked before use and
+    // the exchange below fails in that case.
+    std::size_t k = 0;
+    while (k != n && i && is_valid(i)) {
+      out[k++] = i;
+      i = load_link(i);
+    }
+
+    if (i && !is_valid(i)) {
+      h = free.load(std::memory_order_acquire);
+      continue;
+    }
+
+    if (free.compare_exchange_weak( h, pack(i, h)
+                                  , std::memory_order_acquire
+                                  , std::memory_order_acquire)) {
+      out += k;
+      n -= k;
+    }
+  }
+  counters.on_alloc(n0 - n);
+  return n0 - n;
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::push( const I* in, std::size_t n
+                                   , std::false_type) noexcept
+{
+  for (std::size_t k = 0; k < n; ++k)
+    push(pointer(this, in[k]));
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::push( const I* in, std::size_t n
+                                   , std::true_type) noexcept
+{
+  for (std::size_t k = 0; k + 1 < n; ++k)
+    store_link(in[k], in[k + 1]);
+
+  counters.on_free(n);
+  push_chain(in[0], in[n - 1], std::true_type());
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::push_chain( I first, I last
+                                         , std::false_type) noexcept
+{
+  if (P::address_ordered) {
+    for (auto i = first; i != last; i = get_base_ptr(i)[get_raw_idx(i)])
+      free_bits.set(i);
+    free_bits.set(last);
+    return;
+  }
+  get_base_ptr(last)[get_raw_idx(last)] = free;
+  free = first;
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::push_chain( I first, I last
+                                         , std::true_type) noexcept
+{
+  auto h = free.load(std::memory_order_relaxed);
+  do {
+    store_link(last, static_cast<I>(h));
+  } while (!free.compare_exchange_weak( h, pack(first, h)
+                                      , std::memory_order_release
+                                      , std::memory_order_relaxed));
+}
+
+template <class T, class I, std::size_t N, class P>
+std::pair< typename node_storage<T, I, N, P>::pointer
+         , typename node_storage<T, I, N, P>::pointer>
+node_storage<T, I, N, P>::pop_n(std::size_t n)
+{
+  for (;;) {
+    if (P::address_ordered) {
+      const auto r = take_lowest(n);
+      if (r.first == r.second) {
+        const auto p = exhausted();
+        return std::make_pair(p, p);
+      }
+      on_taken(r.first, r.second);
+      return std::make_pair( pointer(this, r.first)
+                           , pointer(this, r.second));
+    }
 
+    if (P::fixed || n <= 1 || has_free()) {
+      auto p = pop();
+      auto q = p;
+      if (p)
+        ++q;
+      return std::make_pair(p, q);
+    }
+
+    const auto r = take(n, is_concurrent());
+    on_taken(r.first, r.second);
+    if (r.first != r.second)
+      return std::make_pair( pointer(this, r.first)
+                           , pointer(this, r.second));
+    grow();
+  }
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::reserve(std::size_t n)
+{
+  if (n > max_size())
+    throw std::length_error("node_storage::reserve");
+
+  std::lock_guard<mutex_type> lock(mtx);
+  bufs.reserve(block_of(n) + 1);
+  while (capacity() < n)
+    link_bloc(add_bloc());
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::grow()
+{
+  std::lock_guard<mutex_type> lock(mtx);
+  // Another thread may have grown the pool while we waited.
+  if (has_free() || get_fresh(is_concurrent()).second)
+    return;
+
+  const auto b = add_bloc();
+  if (P::address_ordered) {
+    link_bloc(b);
+    return;
+  }
+  const auto i = first_node(b);
+  set_fresh(i, static_cast<I>(last_node(b) - i + 1), is_concurrent());
+}
+
+template <class T, class I, std::size_t N, class P>
+std::pair<I, I>
+node_storage<T, I, N, P>::take(std::size_t n, std::false_type) noexcept
+{
+  const auto k = static_cast<I>(std::min<std::size_t>(n, fresh.second));
+  const auto i = fresh.first;
+  fresh.first = static_cast<I>(i + k);
+  fresh.second = static_cast<I>(fresh.second - k);
+  return std::make_pair(i, static_cast<I>(i + k));
+}
+
+template <class T, class I, std::size_t N, class P>
+std::pair<I, I>
+node_storage<T, I, N, P>::take(std::size_t n, std::true_type) noexcept
+{
+  auto f = fresh.load(std::memory_order_acquire);
+  for (;;) {
+    const auto i = f >> 32;
+    const auto m = f & 0xffffffff;
+    const auto k = std::min<std::uint64_t>(n, m);
+    if (k == 0)
+      return std::make_pair(I(0), I(0));
+    if (fresh.compare_exchange_weak( f, ((i + k) << 32) | (m - k)
+                                   , std::memory_order_acquire
+                                   , std::memory_order_acquire))
+      return std::make_pair( static_cast<I>(i)
+                           , static_cast<I>(i + k));
+  }
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::link_bloc(std::size_t k)
+{
+  const auto last = last_node(k);
+  if (P::address_ordered) {
+    for (std::size_t i = first_node(k); i <= last; ++i)
+      free_bits.set(i);
+    return;
+  }
+
+  auto b = bufs[k];
+  for (auto i = first_node(k); i != last; ++i)
+    b[get_raw_idx(i)] = static_cast<I>(i + 1);
+  push_chain(first_node(k), last, is_concurrent());
+}
+
+template <class T, class I, std::size_t N, class P>
+std::size_t node_storage<T, I, N, P>::add_bloc()
+{
+    // Nodes are not linked, that is left to the caller.
+    // Slots of released blocks are filled before the table grows.
+    const auto n = holes.empty() ? bufs.size() : holes.back();
+    if (block_begin(n + 1) - 1 > max_size())
+      throw std::length_error("node_storage: Out of indexes.");
+    auto b = alloc_bloc(n, is_contiguous());
+    counters.on_growth();
+    if (holes.empty()) {
+      try {
+        if (P::occupancy)
+          occ.resize(block_begin(n + 1) / N * bitmap_words, 0);
+        if (P::address_ordered)
+          free_bits.resize(block_begin(n + 1));
+        bufs.push_back(b);
+      } catch (...) {
+        free_bloc(b, n, is_contiguous());
+        throw;
+      }
+    } else {
+      bufs[n] = b;
+      holes.pop_back();
+    }
+    return n;
+}
+
+template <class T, class I, std::size_t N, class P>
+std::size_t node_storage<T, I, N, P>::shrink_to_fit()
+{
+  std::lock_guard<mutex_type> lock(mtx);
+
+  // Counts the free nodes in each block.
+  std::vector<std::size_t> n_free(bufs.size(), 0);
+  auto i = static_cast<I>(free);
+  for (; i; i = get_base_ptr(i)[get_raw_idx(i)])
+    ++n_free[block_of(i)];
+  for (std::size_t k = 0; P::address_ordered && k < free_bits.size(); ++k)
+    n_free[block_of(k)] += free_bits.test(k);
+
+  const auto f = get_fresh(is_concurrent());
+  if (f.second)
+    n_free[block_of(f.first)] += f.second;
+
+  std::size_t n = 0;
+  for (std::size_t k = 0; k < bufs.size(); ++k) {
+    const auto full = last_node(k) - first_node(k) + 1u;
+    n_free[k] = bufs[k] && n_free[k] == full;
+    n += n_free[k];
+  }
+
+  // A persistent storage keeps its blocks contiguous in the file, so
+  // only the empty blocks at its end are released.
+  if (P::persistent) {
+    auto k = bufs.size();
+    while (k != 0 && n_free[k - 1])
+      --k;
+    for (std::size_t j = 0; j < k; ++j) {
+      n -= n_free[j];
+      n_free[j] = 0;
+    }
+  }
+
+  if (n == 0)
+    return 0;
+
+  // Unlinks the nodes of the blocks to release, the others keep their
+  // order.
+  I head = 0;
+  I* prev = &head;
+  for (i = static_cast<I>(free); i; i = *prev) {
+    auto* link = get_base_ptr(i) + get_raw_idx(i);
+    if (n_free[block_of(i)]) {
+      *prev = *link;
+    } else {
+      *prev = i;
+      prev = link;
+    }
+  }
+  set_free(head, is_concurrent());
+  if (f.second && n_free[block_of(f.first)])
+    set_fresh(0, 0, is_concurrent());
+
+  for (std::size_t k = 0; k < bufs.size(); ++k) {
+    if (n_free[k]) {
+      for (auto j = block_begin(k); P::address_ordered
+           && j != block_begin(k + 1); ++j)
+        free_bits.reset(j);
+      free_bloc(bufs[k], k, is_contiguous());
+      bufs[k] = nullptr;
+    }
+  }
+
+  // The table only keeps the released slots that precede a block in
+  // use.
+  while (bufs.size() != 0 && !bufs.back())
+    bufs.pop_back();
+  if (P::occupancy)
+    occ.resize(block_begin(bufs.size()) / N * bitmap_words);
+  if (P::address_ordered)
+    free_bits.resize(block_begin(bufs.size()));
+
+  holes.clear();
+  for (auto k = bufs.size(); k != 0; --k)
+    if (!bufs[k - 1])
+      holes.push_back(k - 1);
+
+  return n;
+}
+
+template <class T, class I, std::size_t N, class P>
+void node_storage<T, I, N, P>::release() noexcept
+{
+  std::lock_guard<mutex_type> lock(mtx);
+  for (auto k = bufs.size(); k != 0; --k) {
+    if (bufs[k - 1])
+      free_bloc(bufs[k - 1], k - 1, is_contiguous());
+    bufs.pop_back();
+  }
+  holes.clear();
+  occ.clear();
+  free_bits.resize(0);
+  set_free(0, is_concurrent());
+  set_fresh(0, 0, is_concurrent());
+  root = 0;
+}
+
+template <class T, class I, std::size_t N, class P>
+template <class F>
+std::size_t node_storage<T, I, N, P>::compact(F f)
+{
+  static_assert(!P::monotonic,
+  "node_storage: A monotonic storage does not know its free nodes.");
+  static_assert(P::magazine == 0 && !P::epochs,
+  "node_storage: Cached and retired nodes would be taken as in use.");
+  // The new index of each node in use, zero for free slots.
+  std::vector<I> to;
+  std::size_t n = 0;
+  {
+    std::lock_guard<mutex_type> lock(mtx);
+
+    to.resize(block_begin(bufs.size()), 0);
+    for (std::size_t i = 1; i < to.size(); ++i)
+      if (bufs[block_of(i)])
+        to[i] = static_cast<I>(i);
+
+    auto i = static_cast<I>(free);
+    for (; i; i = get_base_ptr(i)[get_raw_idx(i)])
+      to[i] = 0;
+    for (std::size_t k = 0; P::address_ordered && k < to.size(); ++k)
+      if (free_bits.test(k))
+        to[k] = 0;
+
+    const auto fr = get_fresh(is_concurrent());
+    for (I k = 0; k != fr.second; ++k)
+      to[fr.first + k] = 0;
+
+    // Moves the last node in use to the first free slot until they
+    // meet. Slots below hi are then in use and the others free.
+    std::size_t lo = 1;
+    std::size_t hi = to.size();
+    for (;;) {
+      while (lo < hi && (to[lo] || !is_valid(static_cast<I>(lo))))
+        ++lo;
+      while (lo < hi && !to[hi - 1])
+        --hi;
+      if (lo >= hi)
+        break;
+
+      const auto a = static_cast<I>(lo++);
+      const auto b = static_cast<I>(--hi);
+      ::new (static_cast<void*>(node_at(a))) T(std::move(*node_at(b)));
+      node_at(b)->~T();
+      to[b] = a;
+      if (P::occupancy) {
+        set_in_use(a, true);
+        set_in_use(b, false);
+      }
+      ++n;
+    }
+
+    // The free list is rebuilt in the order of the indexes.
+    I head = 0;
+    if (P::address_ordered) {
+      free_bits.resize(0);
+      free_bits.resize(to.size());
+    }
+    for (auto k = to.size(); k-- > hi;) {
+      const auto j = static_cast<I>(k);
+      if (!is_valid(j))
+        continue;
+      if (P::address_ordered) {
+        free_bits.set(j);
+      } else {
+        get_base_ptr(j)[get_raw_idx(j)] = head;
+        head = j;
+      }
+    }
+    set_free(head, is_concurrent());
+    set_fresh(0, 0, is_concurrent());
+    root = to[root];
+  }
+
+  auto fwd = [&](link_type l) { return link_type(to[l.get_idx()]); };
+  for (std::size_t i = 1; i < to.size(); ++i)
+    if (to[i])
+      f(pointer(this, static_cast<I>(i)), pointer(this, to[i]), fwd);
+
+  shrink_to_fit();
+  return n;
+}
+
+} // rt
@@ -121,6 +121,76 @@ struct allocate_node_helper
 template<typename Alloc>
 using has_allocate_node = typename allocate_node_helper<Alloc>::type;
 
+template<typename Alloc>
+struct allocate_nodes_helper
+{
+  template<typename Alloc2,
+    typename = decltype(std::declval<Alloc2*>()->allocate_nodes(1))>
+  static std::true_type test(int);
+
+  template<typename>
+  static std::false_type test(...);
+
+  using type = decltype(test<Alloc>(0));
+};
+
+template<typename Alloc>
+using has_allocate_nodes = typename allocate_nodes_helper<Alloc>::type;
+
+// A relocation visitor that does nothing, see node_storage::compact.
+struct no_relocation {
+  template <class... Args>
+  void operator()(Args&&...) const noexcept {}
+};
+
+template<typename Alloc>
+struct compact_helper
+{
+  template<typename Alloc2, typename = decltype(
+    std::declval<Alloc2*>()->compact(no_relocation()))>
+  static std::true_type test(int);
+
+  template<typename>
+  static std::false_type test(...);
+
+  using type = decltype(test<Alloc>(0));
+};
+
+template<typename Alloc>
+using has_compact = typename compact_helper<Alloc>::type;
+
+template<typename Alloc>
+struct get_root_helper
+{
+  template<typename Alloc2,
+    typename = decltype(std::declval<Alloc2*>()->get_root())>
+  static std::true_type test(int);
+
+  template<typename>
+  static std::false_type test(...);
+
+  using type = decltype(test<Alloc>(0));
+};
+
+template<typename Alloc>
+using has_root = typename get_root_helper<Alloc>::type;
+
+template<typename Alloc>
+struct drops_nodes_helper
+{
+  template<typename Alloc2,
+    typename = decltype(std::declval<const Alloc2*>()->drops_nodes())>
+  static std::true_type test(int);
+
+  template<typename>
+  static std::false_type test(...);
+
+  using type = decltype(test<Alloc>(0));
+};
+
+template<typename Alloc>
+using has_drops_nodes = typename drops_nodes_helper<Alloc>::type;
+
 template <typename T>
 struct is_node {
   static const bool value = !std::is_pointer<T>::value;
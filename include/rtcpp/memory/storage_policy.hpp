@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+
+#include "block_provider.hpp"
+
+/*
+  Compile time options of node_storage. To change an option, derive
+  from one of the policies below and hide the respective member.
+*/
+
+namespace rt {
+
+// Where node pointers find their storage. Unbound pointers carry a
+// pointer to it. Bound ones are as small as an index and refer to
+// the storage bound for the same type, in the process or in the
+// calling thread: the first one constructed while none is, or the
+// one bind was last called on. A distinct policy type, used as a
+// tag, is then needed for each storage in use at the same time.
+enum bind_mode { unbound, process_bound, thread_bound };
+
+struct storage_policy {
+  static constexpr bool concurrent = false; // Thread-safe pop and push.
+  static constexpr std::size_t magazine = 0; // Per thread cache size.
+  using provider = new_provider; // Where blocks come from.
+  static constexpr bool fixed = false; // Grows only in reserve.
+  static void exhausted() {} // Called when a fixed storage runs out.
+  static constexpr bool contiguous = false; // Blocks at fixed offsets.
+  static constexpr bind_mode binding = unbound;
+  static constexpr bool occupancy = false; // Bitmap of nodes in use.
+  static constexpr bool address_ordered = false; // Lowest free first.
+  static constexpr bool statistics = false; // Counters of stats().
+  static constexpr bool persistent = false; // State kept in a file.
+  static constexpr std::size_t max_pooled = 0; // See array_pool.
+  static constexpr bool geometric = false; // Block k holds N << k nodes.
+  static constexpr bool monotonic = false; // Nodes are never reused.
+  static constexpr bool epochs = false; // Deferred reuse, see epoch_domain.
+};
+
+struct concurrent_policy : storage_policy {
+  static constexpr bool concurrent = true;
+};
+
+// Puts a per thread cache of free nodes in front of the storage.
+struct cached_policy : concurrent_policy {
+  static constexpr std::size_t magazine = 64;
+};
+
+// Never allocates after reserve, pop returns a null pointer instead.
+struct fixed_policy : storage_policy {
+  static constexpr bool fixed = true;
+};
+
+// Keeps track of the nodes in use so that they can be visited in
+// memory order, see node_storage::live.
+struct occupancy_policy : storage_policy {
+  static constexpr bool occupancy = true;
+};
+
+// Hands out the free node of lowest index instead of the last
+// released, so that long lived nodes gather at the front of the pool
+// and the blocks at the end empty out.
+struct address_ordered_policy : storage_policy {
+  static constexpr bool address_ordered = true;
+};
+
+// Doubles the size of each block added, so that n nodes take
+// O(log n) blocks instead of n / N.
+struct geometric_policy : storage_policy {
+  static constexpr bool geometric = true;
+};
+
+// Ignores the nodes given back, so that releasing them costs
+// nothing. Memory is only given back whole, with the storage or
+// node_storage::release, and containers with trivially destructible
+// elements are destroyed without visiting their nodes.
+struct monotonic_policy : storage_policy {
+  static constexpr bool monotonic = true;
+};
+
+// Lets threads read nodes that others release, see epoch_domain. The
+// nodes released through node_allocator are reused once no reader can
+// see them anymore.
+struct epoch_policy : concurrent_policy {
+  static constexpr bool epochs = true;
+};
+
+// Counts allocations, frees and growth, see node_storage::stats.
+struct statistics_policy : storage_policy {
+  static constexpr bool statistics = true;
+};
+
+// Recycles the arrays node_allocator hands out besides nodes, like
+// the buckets and nodes of std::unordered_set, see array_pool.
+struct pooled_policy : storage_policy {
+  static constexpr std::size_t max_pooled = 1 << 14;
+};
+
+struct bound_policy : storage_policy {
+  static constexpr bind_mode binding = process_bound;
+};
+
+struct thread_bound_policy : storage_policy {
+  static constexpr bind_mode binding = thread_bound;
+};
+
+// Takes the blocks from the allocator of node_allocator.
+template <class A = std::allocator<char>>
+struct upstream_policy : storage_policy {
+  using provider = allocator_provider<A>;
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+// All blocks live in one reserved range of addresses, so a node is
+// reached without looking its block up.
+struct contiguous_policy : storage_policy {
+  static constexpr bool contiguous = true;
+  using provider = vm_provider;
+};
+
+// Keeps the nodes in a file together with the state of the storage,
+// which is loaded when the storage is constructed and saved when it
+// is destroyed. As nodes refer to each other by index, a container
+// left in the file by one process is used as is by the next one, see
+// rt::set::persist. Keys must not point outside the file.
+struct persistent_policy : contiguous_policy {
+  static constexpr bool persistent = true;
+  using provider = file_provider;
+};
+
+// A persistent storage in a POSIX shared memory object, so that
+// processes attach to the containers it holds instead of keeping a
+// copy each. It is written by one process at a time, the others
+// attach once it is built.
+struct shared_policy : persistent_policy {
+  using provider = shm_provider;
+};
+
+// Backs the blocks with huge pages where possible. Blocks should be
+// a multiple of 2MB for it to take effect.
+struct huge_page_policy : storage_policy {
+  using provider = mmap_provider<mmap_hugetlb | mmap_thp>;
+};
+#endif
+
+}
+
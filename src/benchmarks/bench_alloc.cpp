@@ -0,0 +1,113 @@
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include <rtcpp/utility/timer.hpp>
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+
+using T = int;
+using L = unsigned;
+using node_type = typename rt::set<T>::node_type;
+
+template <class P>
+using alloc_type =
+  rt::node_allocator<T, node_type, L, 256, std::allocator<T>, P>;
+
+using alloc1 = alloc_type<rt::concurrent_policy>;
+using alloc2 = alloc_type<rt::storage_policy>;
+using alloc3 = alloc_type<rt::cached_policy>;
+
+// Serializes a single threaded allocator on a mutex.
+struct locked_alloc {
+  using inner_type =
+    typename alloc2::template rebind<alloc2::node_type>::other;
+  using pointer = typename inner_type::pointer;
+  std::mutex mtx;
+  inner_type alloc;
+
+  auto allocate_node()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    return alloc.allocate_node();
+  }
+
+  void deallocate_node(pointer p)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    alloc.deallocate_node(p);
+  }
+};
+
+template <class A>
+void bench(A& a, int n_threads, int N, int K)
+{
+  using pointer = decltype(a.allocate_node());
+  auto func = [&]()
+  {
+    std::vector<pointer> v(N);
+    for (int k = 0; k < K; ++k) {
+      for (auto& p : v)
+        p = a.allocate_node();
+      for (auto& p : v)
+        a.deallocate_node(p);
+    }
+  };
+
+  rt::timer t;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < n_threads; ++i)
+    threads.emplace_back(func);
+
+  for (auto& th : threads)
+    th.join();
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 4) {
+    std::cout <<
+    "\nUsage: $ ./bench_alloc N K T\n"
+    "N: Number of nodes allocated by each thread.\n"
+    "K: How many times each thread allocates and releases them.\n"
+    "T: Maximum number of threads.\n"
+    << std::endl;
+    std::cout <<
+    "The program output has the following layout: \n"
+    "(0) (1) (2) (3): \n"
+    "Where: \n"
+    "(0)  Number of threads.\n"
+    "(1)  rt::node_allocator<rt::concurrent_policy>\n"
+    "(2)  rt::node_allocator<rt::storage_policy> with std::mutex\n"
+    "(3)  rt::node_allocator<rt::cached_policy>\n"
+    << std::endl;
+
+    return 0;
+  }
+
+  const int N = rt::to_number<int>(argv[1]);
+  const int K = rt::to_number<int>(argv[2]);
+  const int T = rt::to_number<int>(argv[3]);
+
+  for (int i = 1; i <= T; ++i) {
+    std::cout << i << " ";
+    {
+      typename alloc1::template rebind<alloc1::node_type>::other a;
+      bench(a, i, N, K);
+    }
+    {
+      locked_alloc a;
+      bench(a, i, N, K);
+    }
+    {
+      typename alloc3::template rebind<alloc3::node_type>::other a;
+      bench(a, i, N, K);
+    }
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
+
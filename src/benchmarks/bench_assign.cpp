@@ -0,0 +1,95 @@
+#include <set>
+#include <memory>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/utility/timer.hpp>
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+using T = unsigned;
+using node_type = typename rt::set<T>::node_type;
+using alloc_type = rt::node_allocator<T, node_type, T, 1 << 16>;
+
+template <class B = rt::tbst::unbalanced>
+using set_type = rt::set<T, std::less<T>, alloc_type, B>;
+
+// Past this size the unbalanced tree is not built one key at a
+// time, as that takes quadratic time on sorted keys.
+constexpr std::size_t max_quadratic = 20000;
+
+// Times the insertion of the keys one after the other.
+template <class C>
+void print_insert_bench(const std::vector<T>& data)
+{
+  C c;
+  rt::timer t;
+  for (auto k : data)
+    c.insert(k);
+}
+
+// Times the construction from the range.
+template <class C>
+void print_range_bench(const std::vector<T>& data)
+{
+  std::unique_ptr<C> c;
+  rt::timer t;
+  c.reset(new C(std::begin(data), std::end(data)));
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 4) {
+    std::cout <<
+    "\nUsage: $ ./bench_assign N S K\n"
+    "N: The start size.\n"
+    "S: The step size.\n"
+    "K: How many steps.\n"
+    << std::endl;
+    std::cout <<
+    "The program output has the following layout: \n"
+    "(0) (1) (2) (3) (4) (5): \n"
+    "Where: \n"
+    "(0)  Number of keys.\n"
+    "(1)  Time to insert the sorted keys one by one in a rt::set.\n"
+    "     Left out as - above 20000 keys, as it is quadratic.\n"
+    "(2)  Same with rt::set<rt::tbst::avl>.\n"
+    "(3)  Time to build a rt::set from the sorted keys, see\n"
+    "     rt::set::assign_sorted.\n"
+    "(4)  Same from the keys shuffled, that are sorted first.\n"
+    "(5)  Time to build a std::set from the sorted keys.\n"
+    "All sets but (5) use rt::node_allocator.\n"
+    << std::endl;
+
+    return 0;
+  }
+
+  const std::size_t N = rt::to_number<std::size_t>(argv[1]);
+  const std::size_t S = rt::to_number<std::size_t>(argv[2]);
+  const std::size_t K = rt::to_number<std::size_t>(argv[3]);
+
+  for (std::size_t i = 0; i < K; ++i) {
+    const auto n = N + i * S;
+    std::vector<T> shuffled =
+      rt::make_rand_data<T>(n, 1, std::numeric_limits<T>::max());
+    std::vector<T> sorted = shuffled;
+    std::sort(std::begin(sorted), std::end(sorted));
+
+    std::cout << sorted.size() << " ";
+    if (n <= max_quadratic)
+      print_insert_bench<set_type<>>(sorted);
+    else
+      std::cout << "- ";
+    print_insert_bench<set_type<rt::tbst::avl>>(sorted);
+    print_range_bench<set_type<>>(sorted);
+    print_range_bench<set_type<>>(shuffled);
+    print_range_bench<std::set<T>>(sorted);
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
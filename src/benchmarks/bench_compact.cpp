@@ -0,0 +1,59 @@
+#include <vector>
+#include <iostream>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+#include "print_set_bench.hpp"
+
+using T = unsigned;
+using node_type = typename rt::set<T>::node_type;
+using set_type =
+  rt::set<T, std::less<T>, rt::node_allocator<T, node_type, T, 256>>;
+
+int main(int argc, char* argv[])
+{
+  if (argc != 4) {
+    std::cout <<
+    "\nUsage: $ ./bench_compact N S K\n"
+    "N: The start size.\n"
+    "S: The step size.\n"
+    "K: How many steps.\n"
+    << std::endl;
+    std::cout <<
+    "The program output has the following layout: \n"
+    "(0) (1) (2) (3) (4) (5): \n"
+    "Where: \n"
+    "(0)  Number of elements, half of which are in the set during\n"
+    "     the churn of print_set_bench and an eighth after it.\n"
+    "(1)  Time of the churn.\n"
+    "(2)  Time of 100 traversals before rt::set::compact.\n"
+    "(3)  Blocks in use before.\n"
+    "(4)  Time of 100 traversals after.\n"
+    "(5)  Blocks in use after.\n"
+    << std::endl;
+
+    return 0;
+  }
+
+  const std::size_t N = rt::to_number<std::size_t>(argv[1]);
+  const std::size_t S = rt::to_number<std::size_t>(argv[2]);
+  const std::size_t K = rt::to_number<std::size_t>(argv[3]);
+
+  const std::vector<T> data =
+    rt::make_rand_data<T>( N + (K - 1) * S
+                         , 1
+                         , std::numeric_limits<T>::max());
+
+  for (std::size_t i = 0; i < K; ++i) {
+    const auto n = N + i * S;
+    std::cout << n << " ";
+    rt::print_compact_bench<set_type>(data, n);
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
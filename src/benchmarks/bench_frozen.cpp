@@ -0,0 +1,89 @@
+#include <set>
+#include <vector>
+#include <iostream>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/utility/timer.hpp>
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/container/frozen_set.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+using T = unsigned;
+using node_type = typename rt::set<T>::node_type;
+using alloc_type = rt::node_allocator<T, node_type, T, 1 << 16>;
+
+template <class B>
+using set_type = rt::set<T, std::less<T>, alloc_type, B>;
+
+// Times the lookup of each key in c, of which about half are in it.
+// The sum keeps the lookups from being optimised away.
+template <class C>
+void print_find_bench(const C& c, const std::vector<T>& keys)
+{
+  std::size_t found = 0;
+  {
+    rt::timer t;
+    for (auto k : keys)
+      found += c.find(k) != std::end(c);
+  }
+  if (found > keys.size())
+    std::cout << "? ";
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 4) {
+    std::cout <<
+    "\nUsage: $ ./bench_frozen N S K\n"
+    "N: The start size.\n"
+    "S: The step size.\n"
+    "K: How many steps.\n"
+    << std::endl;
+    std::cout <<
+    "The program output has the following layout: \n"
+    "(0) (1) (2) (3) (4): \n"
+    "Where: \n"
+    "(0)  Number of keys in the set, looked up 4 times as many\n"
+    "     times, half of them missing.\n"
+    "(1)  Lookup time in a rt::set built from random keys.\n"
+    "(2)  Same with rt::set<rt::tbst::avl>.\n"
+    "(3)  Same with a rt::frozen_set made from (2).\n"
+    "(4)  Same with std::set.\n"
+    "The sets in (1) and (2) use rt::node_allocator.\n"
+    << std::endl;
+
+    return 0;
+  }
+
+  const std::size_t N = rt::to_number<std::size_t>(argv[1]);
+  const std::size_t S = rt::to_number<std::size_t>(argv[2]);
+  const std::size_t K = rt::to_number<std::size_t>(argv[3]);
+
+  for (std::size_t i = 0; i < K; ++i) {
+    const auto n = N + i * S;
+    const auto data =
+      rt::make_rand_data<T>(2 * n, 1, std::numeric_limits<T>::max());
+    const auto m = data.size() / 2;
+    std::vector<T> keys;
+    for (int j = 0; j < 2; ++j)
+      keys.insert(std::end(keys), std::begin(data), std::end(data));
+
+    alloc_type a;
+    const set_type<rt::tbst::unbalanced>
+      s1(data.begin(), data.begin() + m, a);
+    const set_type<rt::tbst::avl> s2(data.begin(), data.begin() + m, a);
+    const rt::frozen_set<T> f(s2);
+    const std::set<T> r(data.begin(), data.begin() + m);
+
+    std::cout << m << " ";
+    print_find_bench(s1, keys);
+    print_find_bench(s2, keys);
+    print_find_bench(f, keys);
+    print_find_bench(r, keys);
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
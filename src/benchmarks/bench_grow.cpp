@@ -0,0 +1,97 @@
+#include <array>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <iostream>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+
+using T = int;
+using node_type = typename rt::set<T>::node_type;
+using clock_type = std::chrono::steady_clock;
+
+template <std::size_t S, class P = rt::storage_policy>
+using node_alloc =
+  rt::node_allocator<T, node_type, unsigned, S, std::allocator<T>, P>;
+
+template <std::size_t S, class P = rt::storage_policy>
+using alloc_type =
+  typename node_alloc<S, P>::template rebind<
+    typename node_alloc<S, P>::node_type>::other;
+
+// Latencies in buckets of powers of two nanoseconds.
+using histogram = std::array<long, 32>;
+
+template <class F>
+histogram bench(int n, F alloc)
+{
+  histogram h {};
+  for (int i = 0; i < n; ++i) {
+    const auto t0 = clock_type::now();
+    alloc();
+    const auto t1 = clock_type::now();
+    const auto ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0);
+    int k = 0;
+    while (k < 31 && (1L << k) < ns.count())
+      ++k;
+    ++h[k];
+  }
+  return h;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 2) {
+    std::cout <<
+    "\nUsage: $ ./bench_grow N\n"
+    "N: Number of nodes allocated one after the other.\n"
+    << std::endl;
+    std::cout <<
+    "The program output has the following layout: \n"
+    "(0) (1) (2) (3) (4): \n"
+    "Where: \n"
+    "(0)  Upper bound of the latency of the bucket in ns.\n"
+    "(1)  rt::node_allocator with blocks of 2^16 nodes.\n"
+    "(2)  rt::node_allocator with blocks of 256 nodes.\n"
+    "(3)  rt::node_allocator with blocks of 256 << k nodes.\n"
+    "(4)  std::allocator\n"
+    "Rows with no sample are omitted. Growth events show up as the\n"
+    "rightmost samples of (1), (2) and (3). A last row has the\n"
+    "number of blocks of each.\n"
+    << std::endl;
+
+    return 0;
+  }
+
+  const int N = rt::to_number<int>(argv[1]);
+
+  alloc_type<1 << 16> a1;
+  alloc_type<256> a2;
+  alloc_type<256, rt::geometric_policy> a3;
+  std::vector<node_type*> v;
+  v.reserve(N);
+  std::allocator<node_type> a4;
+
+  const auto h1 = bench(N, [&]() { a1.allocate_node(); });
+  const auto h2 = bench(N, [&]() { a2.allocate_node(); });
+  const auto h3 = bench(N, [&]() { a3.allocate_node(); });
+  const auto h4 = bench(N, [&]() { v.push_back(a4.allocate(1)); });
+
+  for (std::size_t k = 0; k < h1.size(); ++k) {
+    if (h1[k] == 0 && h2[k] == 0 && h3[k] == 0 && h4[k] == 0)
+      continue;
+    std::cout << (1L << k) << " " << h1[k] << " " << h2[k] << " "
+              << h3[k] << " " << h4[k] << std::endl;
+  }
+  std::cout << "- " << a1.get_n_blocks() << " " << a2.get_n_blocks()
+            << " " << a3.get_n_blocks() << " " << N << std::endl;
+
+  for (auto p : v)
+    a4.deallocate(p, 1);
+
+  return 0;
+}
+
@@ -39,7 +39,9 @@ int main(int argc, char* argv[])
     "(0) (1): \n"
     "Where: \n"
     "(0)  Number of elements.\n"
-    "(1)  std::forward_list\n"
+    "(1)  rt::forward_list\n"
+    "The three sections are for std::allocator, rt::node_allocator\n"
+    "and rt::node_allocator<rt::contiguous_policy>.\n"
     << std::endl;
 
     return 0;
@@ -63,8 +65,17 @@ int main(int argc, char* argv[])
                       , std::make_unsigned<T>::type
                       , 1024>;
 
+  using alloc_type2 =
+    rt::node_allocator< T
+                      , node_type
+                      , std::make_unsigned<T>::type
+                      , 1024
+                      , std::allocator<T>
+                      , rt::contiguous_policy>;
+
   using cont_type1 = rt::forward_list<T>;
   using cont_type2 = rt::forward_list<T, alloc_type>;
+  using cont_type3 = rt::forward_list<T, alloc_type2>;
 
   for (std::size_t i = 0; i < K; ++i) {
     const unsigned n = N + i * S;
@@ -81,6 +92,15 @@ int main(int argc, char* argv[])
     rt::print_list_bench<cont_type2>(data);
     std::cout << std::endl;
   }
+
+  std::cout << "__________" << std::endl;
+
+  for (std::size_t i = 0; i < K; ++i) {
+    const unsigned n = N + i * S;
+    std::cout << n << " ";
+    rt::print_list_bench<cont_type3>(data);
+    std::cout << std::endl;
+  }
   return 0;
 }
 
@@ -1,3 +1,4 @@
+#include <set>
 #include <iterator>
 #include <iostream>
 #include <algorithm>
@@ -30,20 +31,32 @@ using node_type = typename rt::set<T>::node_type;
 
 using type1 = set_type<std::allocator<T>>;
 using type2 = set_type<rt::node_allocator<T, node_type, L>>;
+using type3 =
+  set_type<rt::node_allocator< T, node_type, L, 256, std::allocator<T>
+                             , rt::contiguous_policy>>;
+using type4 =
+  set_type<rt::node_allocator< T, node_type, L, 256, std::allocator<T>
+                             , rt::address_ordered_policy>>;
+using type8 =
+  rt::set< T, std::less<T>, rt::node_allocator<T, node_type, L>
+         , rt::tbst::avl>;
+using type9 = std::set<T>;
 #ifdef GNU_FOUND
-using type3 = set_type<__gnu_cxx::__pool_alloc<T>>;
-using type4 = set_type<__gnu_cxx::bitmap_allocator<T>>;
-using type5 = set_type<__gnu_cxx::__mt_alloc<T>>;
+using type5 = set_type<__gnu_cxx::__pool_alloc<T>>;
+using type6 = set_type<__gnu_cxx::bitmap_allocator<T>>;
+using type7 = set_type<__gnu_cxx::__mt_alloc<T>>;
 #endif
 
 void print_info()
 {
   std::cout << "Size 1: " << sizeof (type1::node_type) << std::endl;
   std::cout << "Size 2: " << sizeof (type2::node_type) << std::endl;
-#ifdef GNU_FOUND
   std::cout << "Size 3: " << sizeof (type3::node_type) << std::endl;
   std::cout << "Size 4: " << sizeof (type4::node_type) << std::endl;
+#ifdef GNU_FOUND
   std::cout << "Size 5: " << sizeof (type5::node_type) << std::endl;
+  std::cout << "Size 6: " << sizeof (type6::node_type) << std::endl;
+  std::cout << "Size 7: " << sizeof (type7::node_type) << std::endl;
 #endif
 }
 
@@ -58,15 +71,23 @@ int main(int argc, char* argv[])
     "B: Chars between.\n"
     "F: Optional (any value). If provided will not fragment the\n"
     "   heap before benchmarks.\n\n"
-    "The program outputs has the following layout: \n"
-    "(0) (1) (2) (3) (4) (5): \n"
-    "Where: \n"
-    "(0)  Number of elements.\n"
+    "The program outputs a section per set type, each row\n"
+    "being the number of elements, the time of the insertions and\n"
+    "deletions and the time of traversing what they left. Sections:\n"
     "(1)  std::set<std::allocator>\n"
     "(2)  std::set<rt::node_allocator>\n"
-    "(3)  std::set<__gnu_cxx::__pool_alloc>\n"
-    "(4)  std::set<__gnu_cxx::bitmap_alloc>\n"
-    "(5)  std::set<__mt_alloc>\n\n";
+    "(3)  std::set<rt::node_allocator<rt::contiguous_policy>>\n"
+    "(4)  std::set<rt::node_allocator<rt::address_ordered_policy>>\n"
+    "(5)  std::set<__gnu_cxx::__pool_alloc>\n"
+    "(6)  std::set<__gnu_cxx::bitmap_alloc>\n"
+    "(7)  std::set<__mt_alloc>\n"
+    "(8)  rt::set<rt::node_allocator, rt::tbst::avl>\n"
+    "(9)  std::set, the standard red-black tree\n"
+    "Sections (2), (8) and (9) are then repeated with the data\n"
+    "sorted, that degenerates the tree of (2), and with the data\n"
+    "nearly sorted, every seventh key swapped with the next. Rows\n"
+    "of the latter have the time of inserting the keys one by one\n"
+    "and that of inserting them hinted by the last position.\n\n";
     return 0;
   }
 
@@ -96,14 +117,41 @@ int main(int argc, char* argv[])
   bench<type1>(N, S, K, data);
   std::cout << "(2)" << std::endl;
   bench<type2>(N, S, K, data);
-#ifdef GNU_FOUND
   std::cout << "(3)" << std::endl;
   bench<type3>(N, S, K, data);
   std::cout << "(4)" << std::endl;
   bench<type4>(N, S, K, data);
+#ifdef GNU_FOUND
   std::cout << "(5)" << std::endl;
   bench<type5>(N, S, K, data);
+  std::cout << "(6)" << std::endl;
+  bench<type6>(N, S, K, data);
+  std::cout << "(7)" << std::endl;
+  bench<type7>(N, S, K, data);
 #endif
+  std::cout << "(8)" << std::endl;
+  bench<type8>(N, S, K, data);
+  std::cout << "(9)" << std::endl;
+  bench<type9>(N, S, K, data);
+
+  auto sorted = data;
+  std::sort(std::begin(sorted), std::end(sorted));
+  std::cout << "(2) sorted" << std::endl;
+  bench<type2>(N, S, K, sorted);
+  std::cout << "(8) sorted" << std::endl;
+  bench<type8>(N, S, K, sorted);
+  std::cout << "(9) sorted" << std::endl;
+  bench<type9>(N, S, K, sorted);
+
+  auto nearly = sorted;
+  for (std::size_t i = 0; i + 1 < nearly.size(); i += 7)
+    std::swap(nearly[i], nearly[i + 1]);
+  std::cout << "(2) nearly sorted" << std::endl;
+  bench_hint<type2>(N, S, K, nearly);
+  std::cout << "(8) nearly sorted" << std::endl;
+  bench_hint<type8>(N, S, K, nearly);
+  std::cout << "(9) nearly sorted" << std::endl;
+  bench_hint<type9>(N, S, K, nearly);
   std::cout << std::endl;
   std::for_each( std::begin(pointers), std::end(pointers)
                , [](char* p){ delete p;});
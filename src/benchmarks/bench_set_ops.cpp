@@ -0,0 +1,119 @@
+#include <set>
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/utility/timer.hpp>
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+using T = unsigned;
+using node_type = typename rt::set<T>::node_type;
+using alloc_type = rt::node_allocator<T, node_type, T, 1 << 16>;
+using set_type = rt::set<T, std::less<T>, alloc_type, rt::tbst::avl>;
+
+// Intersection and difference of s1 and s2 by looking up each key of
+// s1 in s2.
+template <class C>
+void print_count_bench(const C& s1, const C& s2)
+{
+  for (int k = 0; k < 2; ++k) {
+    std::unique_ptr<C> c;
+    rt::timer t;
+    c.reset(new C(s1.get_allocator()));
+    for (auto key : s1)
+      if ((s2.count(key) != 0) == (k == 0))
+        c->insert(c->end(), key);
+  }
+}
+
+// Same with the linear merges of rt::set.
+void print_merge_bench(const set_type& s1, const set_type& s2)
+{
+  {
+    std::unique_ptr<set_type> c;
+    rt::timer t;
+    c.reset(new set_type(set_intersection(s1, s2)));
+  }
+  {
+    std::unique_ptr<set_type> c;
+    rt::timer t;
+    c.reset(new set_type(set_difference(s1, s2)));
+  }
+}
+
+// Same with std::set_intersection and std::set_difference.
+void print_std_bench(const std::set<T>& s1, const std::set<T>& s2)
+{
+  {
+    std::unique_ptr<std::set<T>> c(new std::set<T>);
+    rt::timer t;
+    std::set_intersection( std::begin(s1), std::end(s1)
+                         , std::begin(s2), std::end(s2)
+                         , std::inserter(*c, c->end()));
+  }
+  {
+    std::unique_ptr<std::set<T>> c(new std::set<T>);
+    rt::timer t;
+    std::set_difference( std::begin(s1), std::end(s1)
+                       , std::begin(s2), std::end(s2)
+                       , std::inserter(*c, c->end()));
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 4) {
+    std::cout <<
+    "\nUsage: $ ./bench_set_ops N S K\n"
+    "N: The start size.\n"
+    "S: The step size.\n"
+    "K: How many steps.\n"
+    << std::endl;
+    std::cout <<
+    "The program output has the following layout: \n"
+    "(0) (1) (2) (3) (4) (5) (6): \n"
+    "Where: \n"
+    "(0)  Number of keys in each of two sets sharing half of them.\n"
+    "(1)  Intersection of two rt::set<rt::tbst::avl> looking up\n"
+    "     the keys of one in the other.\n"
+    "(2)  Same for the difference.\n"
+    "(3)  Intersection with rt::set_intersection.\n"
+    "(4)  Difference with rt::set_difference.\n"
+    "(5)  Intersection of two std::set with std::set_intersection.\n"
+    "(6)  Difference of two std::set with std::set_difference.\n"
+    << std::endl;
+
+    return 0;
+  }
+
+  const std::size_t N = rt::to_number<std::size_t>(argv[1]);
+  const std::size_t S = rt::to_number<std::size_t>(argv[2]);
+  const std::size_t K = rt::to_number<std::size_t>(argv[3]);
+
+  for (std::size_t i = 0; i < K; ++i) {
+    const auto n = N + i * S;
+    const auto data =
+      rt::make_rand_data<T>( 3 * n / 2, 1
+                           , std::numeric_limits<T>::max());
+    const auto m = data.size() / 3;
+    alloc_type a;
+    const set_type s1(data.begin(), data.begin() + 2 * m, a);
+    const set_type s2(data.begin() + m, data.end(), a);
+    const std::set<T> r1(data.begin(), data.begin() + 2 * m);
+    const std::set<T> r2(data.begin() + m, data.end());
+
+    std::cout << s1.size() << " ";
+    print_count_bench(s1, s2);
+    print_merge_bench(s1, s2);
+    print_std_bench(r1, r2);
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
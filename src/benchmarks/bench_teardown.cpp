@@ -0,0 +1,84 @@
+#include <memory>
+#include <vector>
+#include <iostream>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/utility/timer.hpp>
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+using T = unsigned;
+using node_type = typename rt::set<T>::node_type;
+
+template <class P = rt::storage_policy>
+using node_alloc =
+  rt::node_allocator<T, node_type, T, 256, std::allocator<T>, P>;
+
+template <class A>
+using set_type = rt::set<T, std::less<T>, A>;
+
+// Builds a set with the first n elements of data, and the allocator
+// a if given, and times its destruction.
+template <class C, class... A>
+void print_teardown_bench( const std::vector<T>& data, std::size_t n
+                         , const A&... a)
+{
+  std::unique_ptr<C> c(
+    new C(data.begin(), data.begin() + n, std::less<T>(), a...));
+  rt::timer t;
+  c.reset();
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 4) {
+    std::cout <<
+    "\nUsage: $ ./bench_teardown N S K\n"
+    "N: The start size.\n"
+    "S: The step size.\n"
+    "K: How many steps.\n"
+    << std::endl;
+    std::cout <<
+    "The program output has the following layout: \n"
+    "(0) (1) (2) (3) (4): \n"
+    "Where: \n"
+    "(0)  Number of elements inserted.\n"
+    "(1)  Time to destroy a rt::set<std::allocator>.\n"
+    "(2)  Same with a rt::node_allocator whose storage outlives\n"
+    "     the set, that releases its nodes one by one.\n"
+    "(3)  Same with a rt::node_allocator owned by the set, whose\n"
+    "     blocks go with it.\n"
+    "(4)  Same with a rt::node_allocator<rt::monotonic_policy>\n"
+    "     that outlives the set.\n"
+    << std::endl;
+
+    return 0;
+  }
+
+  const std::size_t N = rt::to_number<std::size_t>(argv[1]);
+  const std::size_t S = rt::to_number<std::size_t>(argv[2]);
+  const std::size_t K = rt::to_number<std::size_t>(argv[3]);
+
+  const std::vector<T> data =
+    rt::make_rand_data<T>( N + (K - 1) * S
+                         , 1
+                         , std::numeric_limits<T>::max());
+
+  for (std::size_t i = 0; i < K; ++i) {
+    const auto n = N + i * S;
+    std::cout << n << " ";
+    print_teardown_bench<set_type<std::allocator<T>>>(data, n);
+    node_alloc<> a2;
+    print_teardown_bench<set_type<node_alloc<>>>(data, n, a2);
+    print_teardown_bench<set_type<node_alloc<>>>(data, n);
+    node_alloc<rt::monotonic_policy> a4;
+    using set4_type = set_type<node_alloc<rt::monotonic_policy>>;
+    print_teardown_bench<set4_type>(data, n, a4);
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
+
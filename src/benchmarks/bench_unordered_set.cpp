@@ -0,0 +1,94 @@
+#include <iterator>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+#include <config.h>
+
+#ifdef GNU_FOUND
+#include <ext/pool_allocator.h>
+#endif
+
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+#include <rtcpp/container/set.hpp>
+
+#include "heap_frag.hpp"
+#include "print_set_bench.hpp"
+
+using T = unsigned short;
+using L = unsigned short;
+
+template <class Allocator>
+using set_type =
+  std::unordered_set<T, std::hash<T>, std::equal_to<T>, Allocator>;
+
+using node_type = typename rt::set<T>::node_type;
+
+using type1 = set_type<std::allocator<T>>;
+using type2 =
+  set_type<rt::node_allocator< T, node_type, L, 256, std::allocator<T>
+                             , rt::pooled_policy>>;
+#ifdef GNU_FOUND
+using type3 = set_type<__gnu_cxx::__pool_alloc<T>>;
+#endif
+
+int main(int argc, char* argv[])
+{
+  if ((argc != 5) && (argc != 6)) {
+    std::cout <<
+    "\nUsage: $ ./bench_unordered_set N S K B F\n"
+    "N: The start size.\n"
+    "S: The step size.\n"
+    "K: How many steps.\n"
+    "B: Chars between.\n"
+    "F: Optional (any value). If provided will not fragment the\n"
+    "   heap before benchmarks.\n\n"
+    "The program outputs a section per set type, each row\n"
+    "being the number of elements, the time of the insertions and\n"
+    "deletions and the time of traversing what they left. Nodes and\n"
+    "buckets are both arrays to the allocator. Sections:\n"
+    "(1)  std::unordered_set<std::allocator>\n"
+    "(2)  std::unordered_set<rt::node_allocator<rt::pooled_policy>>\n"
+    "(3)  std::unordered_set<__gnu_cxx::__pool_alloc>\n\n";
+    return 0;
+  }
+
+  using namespace rt;
+
+  std::cout << argv[0] << " "
+            << argv[1] << " "
+            << argv[2] << " "
+            << argv[3] << " "
+            << argv[4] << "\n";
+
+  const int N = to_number<int>(argv[1]);
+  const int S = to_number<int>(argv[2]);
+  const int K = to_number<int>(argv[3]);
+  const int B = to_number<int>(argv[4]);
+  const bool frag = !(argc == 6);
+
+  const std::vector<T> data =
+    rt::make_rand_data<T>( N + (K - 1) * S, 1
+                         , std::numeric_limits<T>::max());
+
+  std::vector<char*> pointers;
+  if (frag) // Fragments the heap.
+    pointers = heap_frag<std::unordered_set<T>>(B, data);
+
+  std::cout << "(1)" << std::endl;
+  bench<type1>(N, S, K, data);
+  std::cout << "(2)" << std::endl;
+  bench<type2>(N, S, K, data);
+#ifdef GNU_FOUND
+  std::cout << "(3)" << std::endl;
+  bench<type3>(N, S, K, data);
+#endif
+  std::cout << std::endl;
+  std::for_each( std::begin(pointers), std::end(pointers)
+               , [](char* p){ delete p;});
+  return 0;
+}
+
@@ -7,6 +7,41 @@
 
 namespace rt {
 
+// Erases and inserts elements of data in c, with a traversal every
+// few steps, so that the nodes of the set end up scattered. c holds
+// the first half of data on entry and on return.
+template <class C>
+void set_churn(C& c, const std::vector<typename C::value_type>& data)
+{
+  const auto n = data.size();
+  const std::size_t s = n / 2;
+  int repeat = 10;
+  for (std::size_t i = 0; i <= s; ++i) {
+    c.erase(data[i]); // Removes already inserted random data.
+    c.insert(data[n - i - 1]); // Inserts the second half of random data.
+    // Traverses the container every *repeat* times
+    if (i % repeat == 0)
+      (void)std::accumulate(std::begin(c), std::end(c), 0);
+  }
+  // Same purpose as the loop above.
+  for (std::size_t i = 0; i <= s; ++i) {
+    c.erase(data[n - i - 1]); // Removes the second half.
+    c.insert(data[i]); // Inserts the first half again.
+    if (i % repeat == 0)
+      (void)std::accumulate(std::begin(c), std::end(c), 0);
+  }
+}
+
+// Times 100 traversals of c.
+template <class C>
+void print_traversal_bench(const C& c)
+{
+  volatile typename C::value_type sink = 0;
+  rt::timer t;
+  for (int k = 0; k < 100; ++k)
+    sink = std::accumulate(std::begin(c), std::end(c), sink);
+}
+
 template <class C>
 void print_set_bench(const std::vector<typename C::value_type>& data)
 {
@@ -16,30 +51,76 @@ void print_set_bench(const std::vector<typename C::value_type>& data)
   //
   // This function is designed to benchmark an sets.  Insertions
   // and deletions are made together to maximize cache misses.
-  const auto n = data.size();
-  const std::size_t s = n / 2;
-  int repeat = 10;
+  const std::size_t s = data.size() / 2;
   // Inserts the first half of the random data in the set. do not
   // participate in the benchmark.
-  //C c;
-  //c.insert(data.begin(), data.begin() + s);
   C c(data.begin(), data.begin() + s);
   {
     rt::timer t;
-    for (std::size_t i = 0; i <= s; ++i) {
-      c.erase(data[i]); // Removes already inserted random data.
-      c.insert(data[n - i - 1]); // Inserts the second half of random data.
-      // Traverses the container every *repeat* times
-      if (i % repeat == 0)
-        (void)std::accumulate(std::begin(c), std::end(c), 0);
-    }
-    // Same purpose as the loop above.
-    for (std::size_t i = 0; i <= s; ++i) {
-      c.erase(data[n - i - 1]); // Removes the second half.
-      c.insert(data[i]); // Inserts the first half again.
-      if (i % repeat == 0)
-        (void)std::accumulate(std::begin(c), std::end(c), 0);
-    }
+    set_churn(c, data);
+  }
+  // The cost of traversing what the churn left.
+  print_traversal_bench(c);
+}
+
+// Churns a set built on the first n elements of data as
+// print_set_bench does, erases three fourths of what is left, so
+// that the nodes in use are scattered over all the blocks, and times
+// repeated traversals before and after compacting the set. The
+// number of blocks in use is printed after each timing.
+template <class C>
+void print_compact_bench( const std::vector<typename C::value_type>& data
+                        , std::size_t n)
+{
+  const std::vector<typename C::value_type>
+    tmp(data.begin(), data.begin() + n);
+  C c(tmp.begin(), tmp.begin() + n / 2);
+  {
+    rt::timer t;
+    set_churn(c, tmp);
+  }
+
+  for (std::size_t i = 0; i < n / 2; ++i)
+    if (i % 4 != 0)
+      c.erase(tmp[i]);
+
+  const auto strg = c.get_allocator().get_node_storage();
+  print_traversal_bench(c);
+  std::cout << strg->get_n_blocks() << " ";
+  c.compact();
+  print_traversal_bench(c);
+  std::cout << strg->get_n_blocks() << " ";
+}
+
+// Times the insertion of data one key at a time, first from the root
+// and then hinted by the position of the key inserted before.
+template <class C>
+void print_hint_bench(const std::vector<typename C::value_type>& data)
+{
+  {
+    C c;
+    rt::timer t;
+    for (auto k : data)
+      c.insert(k);
+  }
+  {
+    C c;
+    rt::timer t;
+    auto hint = c.end();
+    for (auto k : data)
+      hint = c.insert(hint, k);
+  }
+}
+
+template <class T>
+void bench_hint(int N, int S, int K,
+  const std::vector<typename T::value_type>& data)
+{
+  for (int i = 0; i < K; ++i) {
+    const int n = N + i * S;
+    std::cout << n << " ";
+    print_hint_bench<T>(data);
+    std::cout << std::endl;
   }
 }
 
@@ -10,23 +10,28 @@ int main()
   using L = unsigned char;
   using T = L;
   using Node = rt::set<T>::node_type;
-  using A = rt::node_allocator<T, Node, L, 4>;
+  using A = rt::node_allocator< T, Node, L, 4, std::allocator<T>
+                              , rt::occupancy_policy>;
   using C = rt::set<T, std::less<T>, A>;
   using node_type = typename C::node_type;
 
   static_assert((sizeof (node_type) == 4),"");
 
   C t1 {'k', 'd', 'u', 'c', 'l', 'e', 'g', 'b', 'h', 'i'};
+  t1.erase('u');
+  t1.erase('c');
 
   for (auto a: t1)
     std::cout << a << " ";
 
   std::cout << std::endl;;
 
+  // The nodes in use in the order they lie in memory, free ones are
+  // skipped. The first is the head of the tree, that has no key.
   auto alloc = t1.get_allocator().get_node_storage();
-
-  for (auto& a: *alloc)
-    std::cout << a.key << " ";
+  auto live = alloc->live();
+  for (auto iter = ++live.begin(); iter != live.end(); ++iter)
+    std::cout << iter->key << " ";
 
   std::cout << std::endl;
 
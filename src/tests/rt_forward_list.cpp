@@ -186,6 +186,48 @@ void test_basic()
     print(l);
 }
 
+// A fixed size allocator that runs out leaves the elements it
+// cannot hold out.
+void test_fixed()
+{
+  using Node = rt::forward_list<int>::node_type;
+  using A = rt::node_allocator< int, Node, unsigned, 4
+                              , std::allocator<int>, rt::fixed_policy>;
+  A a;
+  a.reserve(7);
+  const std::vector<int> data(20, 3);
+  forward_list<int, A> l(std::begin(data), std::end(data), a);
+
+  const auto n = std::distance(std::begin(l), std::end(l));
+  if (n == 0 || n >= 20)
+    throw std::runtime_error("test_fixed: 1");
+
+  if (l.push_front(5) != l.end()
+      || std::distance(std::begin(l), std::end(l)) != n)
+    throw std::runtime_error("test_fixed: 2");
+
+  if (l.insert_after(l.begin(), 5) != l.end()
+      || std::count(std::begin(l), std::end(l), 5) != 0)
+    throw std::runtime_error("test_fixed: 3");
+
+  // Pushing one by one past the reserve.
+  A b;
+  b.reserve(7);
+  forward_list<int, A> l2(b);
+  int pushed = 0;
+  for (int i = 0; i < 20; ++i) {
+    auto iter = l2.push_front(i);
+    if (iter == l2.end())
+      break;
+    if (*iter != i || l2.begin() != iter)
+      throw std::runtime_error("test_fixed: 4");
+    ++pushed;
+  }
+  if (pushed == 0 || pushed >= 20
+      || std::distance(std::begin(l2), std::end(l2)) != pushed)
+    throw std::runtime_error("test_fixed: 5");
+}
+
 int main()
 {
   try {
@@ -203,6 +245,7 @@ int main()
     //test_basic<A4>();
     test_push_front_copy();
     test_push_front_move();
+    test_fixed();
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
     return 1;
@@ -1,7 +1,15 @@
+#include <array>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
 #include <string>
+#include <thread>
+#include <vector>
 #include <iostream>
 #include <algorithm>
 #include <exception>
+#include <unordered_set>
 
 #include <rtcpp/utility/print.hpp>
 #include <rtcpp/container/set.hpp>
@@ -47,14 +55,641 @@ void test_node_ptr_type()
   cvoid_ptr_t p2 = p1;
   (void) p2;
   //void_ptr_t p3 = p2; // Error
+
+  using bptr_t = node_ptr<unsigned, unsigned short, 4, bound_policy>;
+  using cbptr_t =
+    const_node_ptr<unsigned, unsigned short, 4, thread_bound_policy>;
+  static_assert((sizeof (bptr_t) == sizeof (unsigned short)), "");
+  static_assert((sizeof (cbptr_t) == sizeof (unsigned short)), "");
+  test_nullable_ptr<bptr_t>();
+  test_nullable_ptr<cbptr_t>();
+}
+
+template <std::size_t N>
+void test_occupancy()
+{
+  using strg_type =
+    rt::node_storage<unsigned, unsigned, N, rt::occupancy_policy>;
+  using pointer = typename strg_type::pointer;
+  strg_type strg;
+
+  if (strg.live().begin() != strg.live().end())
+    throw std::runtime_error("test_occupancy: 1");
+
+  std::vector<pointer> v;
+  for (unsigned i = 0; i < 300; ++i) {
+    v.push_back(strg.pop());
+    *v.back() = i;
+  }
+
+  // Every third node is released.
+  std::vector<unsigned> expected;
+  for (unsigned i = 0; i < 300; ++i) {
+    if (i % 3 == 0)
+      strg.push(v[i]);
+    else
+      expected.push_back(i);
+  }
+
+  auto r = strg.pop_n(5); // Reuses a free node.
+  auto q = r.first;
+  if (!strg.in_use(q.get_link().get_idx()))
+    throw std::runtime_error("test_occupancy: 2");
+  strg.link(v[1], v[2]);
+  strg.link(v[2], q);
+  strg.push_chain(v[1], q);
+  expected.erase(std::begin(expected), std::begin(expected) + 2);
+
+  std::vector<unsigned> live;
+  auto last = 0u;
+  for (auto iter = strg.live().begin(); iter != strg.live().end();
+       ++iter) {
+    if (iter.get_idx() <= last)
+      throw std::runtime_error("test_occupancy: 3");
+    last = iter.get_idx();
+    live.push_back(*iter);
+  }
+
+  if (live != expected)
+    throw std::runtime_error("test_occupancy: 4");
+
+  const strg_type& c = strg;
+  if (std::distance(c.live().begin(), c.live().end()) != 198)
+    throw std::runtime_error("test_occupancy: 5");
+}
+
+// Chains the nodes left after releasing most of them and checks
+// the chain survives compaction.
+template <class P>
+void test_compact()
+{
+  struct node {
+    rt::node_link<unsigned> next;
+    unsigned value;
+  };
+  using strg_type = rt::node_storage<node, unsigned, 16, P>;
+  using pointer = typename strg_type::pointer;
+  strg_type strg;
+
+  std::vector<pointer> v;
+  for (unsigned i = 0; i < 400; ++i) {
+    v.push_back(strg.pop());
+    v.back()->value = i;
+  }
+
+  // Keeps every tenth node, chained in reverse order.
+  pointer head;
+  for (unsigned i = 0; i < 400; ++i) {
+    if (i % 10 != 0) {
+      strg.push(v[i]);
+    } else {
+      v[i]->next = head;
+      head = v[i];
+    }
+  }
+
+  const auto blocks = strg.get_n_blocks();
+  std::size_t visits = 0;
+  const auto n = strg.compact([&](pointer from, pointer to, auto fwd)
+  {
+    if (from == head)
+      head = to;
+    to->next = fwd(to->next);
+    ++visits;
+  });
+
+  if (visits != 40 || n == 0 || strg.get_n_blocks() >= blocks)
+    throw std::runtime_error("test_compact: 1");
+
+  // The nodes fill the first slots and keep their values.
+  unsigned expected = 390;
+  std::size_t k = 0;
+  for (auto p = head; p; p = pointer(&strg, p->next.get_idx())) {
+    if (p->value != expected || p.get_link().get_idx() > 40)
+      throw std::runtime_error("test_compact: 2");
+    expected -= 10;
+    ++k;
+  }
+
+  if (k != 40 || strg.capacity() != 47)
+    throw std::runtime_error("test_compact: 3");
+
+  // Nothing left to move.
+  if (strg.compact(rt::no_relocation()) != 0)
+    throw std::runtime_error("test_compact: 4");
+
+  // Free slots are handed out in the order of their indexes.
+  if (strg.pop().get_link().get_idx() != 41)
+    throw std::runtime_error("test_compact: 5");
+}
+
+void test_bit_tree()
+{
+  // Three levels.
+  rt::bit_tree t;
+  t.resize(300000);
+  if (!t.empty() || t.find_first() != 300000)
+    throw std::runtime_error("test_bit_tree: 1");
+
+  // In descending order, each index set becomes the lowest.
+  const std::size_t idx[] = {299999, 70000, 4096, 4095, 64, 3};
+  for (auto i : idx) {
+    t.set(i);
+    if (t.find_first() != i || !t.test(i))
+      throw std::runtime_error("test_bit_tree: 2");
+  }
+
+  std::vector<std::size_t> found;
+  while (!t.empty()) {
+    found.push_back(t.find_first());
+    t.reset(found.back());
+  }
+  if (!std::equal(std::rbegin(idx), std::rend(idx), std::begin(found)
+                 , std::end(found)))
+    throw std::runtime_error("test_bit_tree: 3");
+
+  // Growing keeps the indexes, shrinking drops the levels.
+  t.set(100);
+  t.resize(1 << 20);
+  if (t.find_first() != 100 || !t.test(100) || t.test(101))
+    throw std::runtime_error("test_bit_tree: 4");
+  t.resize(200);
+  if (t.find_first() != 100)
+    throw std::runtime_error("test_bit_tree: 5");
+
+  // Shrinking to a level boundary with bits set, then growing again
+  // rebuilds the top levels from the ones below.
+  t.resize(300000);
+  t.set(4095);
+  t.set(64);
+  t.reset(100);
+  t.resize(4096);
+  if (t.find_first() != 64 || !t.test(4095))
+    throw std::runtime_error("test_bit_tree: 6");
+  t.resize(300000);
+  t.reset(64);
+  if (t.find_first() != 4095)
+    throw std::runtime_error("test_bit_tree: 7");
+  t.set(299999);
+  t.reset(4095);
+  if (t.find_first() != 299999)
+    throw std::runtime_error("test_bit_tree: 8");
+  t.reset(299999);
+  if (!t.empty() || t.find_first() != 300000)
+    throw std::runtime_error("test_bit_tree: 9");
+}
+
+// Released nodes are handed out again lowest first.
+void test_address_ordered()
+{
+  using strg_type =
+    rt::node_storage<unsigned, unsigned, 16, rt::address_ordered_policy>;
+  using pointer = typename strg_type::pointer;
+  strg_type strg;
+
+  std::vector<pointer> v;
+  for (unsigned i = 0; i < 200; ++i) {
+    v.push_back(strg.pop());
+    if (v.back().get_link().get_idx() != i + 1)
+      throw std::runtime_error("test_address_ordered: 1");
+  }
+
+  for (unsigned i : {150u, 7u, 90u, 8u, 199u})
+    strg.push(v[i]);
+
+  for (unsigned i : {7u, 8u, 90u, 150u, 199u, 200u})
+    if (strg.pop().get_link().get_idx() != i + 1)
+      throw std::runtime_error("test_address_ordered: 2");
+
+  // Chains too.
+  strg.link(v[60], v[20]);
+  strg.link(v[20], v[40]);
+  strg.push_chain(v[60], v[40]);
+  for (unsigned i : {20u, 40u, 60u})
+    if (strg.pop().get_link().get_idx() != i + 1)
+      throw std::runtime_error("test_address_ordered: 3");
+
+  // Runs start at the lowest free node and stop at the first node in
+  // use or at the end of its block.
+  for (unsigned i : {31u, 32u, 33u, 35u})
+    strg.push(v[i]);
+  auto r = strg.pop_n(8);
+  if (r.first.get_link().get_idx() != 32 ||
+      r.second.get_link().get_idx() != 35)
+    throw std::runtime_error("test_address_ordered: 4");
+}
+
+template <class P>
+struct stats_of : P {
+  static constexpr bool statistics = true;
+};
+
+template <class P>
+void test_stats()
+{
+  using strg_type = rt::node_storage<unsigned, unsigned, 8, stats_of<P>>;
+  using pointer = typename strg_type::pointer;
+  strg_type strg;
+
+  auto check = [&](std::size_t live, std::size_t peak, std::size_t allocs)
+  {
+    const auto s = strg.stats();
+    return s.live == live && s.peak == peak && s.allocations == allocs
+        && s.frees == allocs - live && s.growths == strg.get_n_blocks()
+        && s.blocks == strg.get_n_blocks()
+        && s.bytes == s.blocks * 8 * sizeof (unsigned);
+  };
+
+  if (!check(0, 0, 0))
+    throw std::runtime_error("test_stats: 1");
+
+  std::vector<pointer> v;
+  for (unsigned i = 0; i < 20; ++i)
+    v.push_back(strg.pop());
+  for (unsigned i = 0; i < 10; ++i)
+    strg.push(v[i]);
+
+  if (!check(10, 20, 20) || strg.get_n_blocks() != 3)
+    throw std::runtime_error("test_stats: 2");
+
+  unsigned idx[5];
+  strg.pop(idx, 5);
+  if (!check(15, 20, 25))
+    throw std::runtime_error("test_stats: 3");
+  strg.push(idx, 5);
+
+  // Runs and chains count every node.
+  auto r = strg.pop_n(30);
+  std::size_t n = 0;
+  for (auto p = r.first; p != r.second; ++n) {
+    auto q = p;
+    if (++q != r.second)
+      strg.link(p, q);
+    p = q;
+  }
+  if (!check(10 + n, 20, 25 + n))
+    throw std::runtime_error("test_stats: 4");
+
+  auto last = r.first;
+  last = r.first.get_link().get_idx() + static_cast<unsigned>(n) - 1;
+  strg.push_chain(r.first, last);
+  for (unsigned i = 10; i < 20; ++i)
+    strg.push(v[i]);
+
+  if (!check(0, 20, 25 + n))
+    throw std::runtime_error("test_stats: 5");
+
+  strg.shrink_to_fit();
+  if (strg.stats().blocks != 0 || strg.stats().bytes != 0)
+    throw std::runtime_error("test_stats: 6");
+}
+
+struct concurrent_pooled_policy : rt::concurrent_policy {
+  static constexpr std::size_t max_pooled = 1 << 10;
+};
+
+template <class P>
+void test_array_pool()
+{
+  using Node = typename rt::set<unsigned>::node_type;
+  using alloc_type =
+    rt::node_allocator< unsigned, Node, unsigned, 64
+                      , std::allocator<unsigned>, P>;
+  using char_alloc_type =
+    typename alloc_type::template rebind<char>::other;
+
+  alloc_type a;
+  char_alloc_type b(a);
+
+  // Arrays of every size up to the largest class are aligned and do
+  // not overlap.
+  std::vector<std::pair<unsigned*, std::size_t>> v;
+  for (std::size_t n = 0; n <= P::max_pooled / sizeof (unsigned); n += 7) {
+    auto p = a.allocate(n);
+    if (reinterpret_cast<std::uintptr_t>(p)
+        % alignof(std::max_align_t) != 0)
+      throw std::runtime_error("test_array_pool");
+    std::fill(p, p + n, static_cast<unsigned>(n));
+    v.push_back({p, n});
+  }
+  for (const auto& x : v)
+    if (std::any_of(x.first, x.first + x.second,
+                    [&](unsigned k){ return k != x.second; }))
+      throw std::runtime_error("test_array_pool");
+
+  // A freed array is handed out again for the same size class, also
+  // through a copy rebound to another type.
+  auto p = a.allocate(10);
+  a.deallocate(p, 10);
+  if (a.allocate(12) != p)
+    throw std::runtime_error("test_array_pool");
+  b.deallocate(reinterpret_cast<char*>(p), 12 * sizeof (unsigned));
+  if (b.allocate(33) != reinterpret_cast<char*>(p))
+    throw std::runtime_error("test_array_pool");
+  b.deallocate(reinterpret_cast<char*>(p), 33);
+
+  for (const auto& x : v)
+    a.deallocate(x.first, x.second);
+
+  // Larger arrays go to the allocator.
+  const std::size_t n = 2 * P::max_pooled;
+  auto q = a.allocate(n);
+  std::fill(q, q + n, 1u);
+  a.deallocate(q, n);
+
+  // Buckets and nodes of a std::unordered_set.
+  std::unordered_set< unsigned, std::hash<unsigned>
+                    , std::equal_to<unsigned>, alloc_type> s(a);
+  for (unsigned i = 0; i < 10000; ++i)
+    s.insert(i);
+  for (unsigned i = 0; i < 10000; i += 2)
+    s.erase(i);
+  for (unsigned i = 0; i < 10000; ++i)
+    if (s.count(i) != i % 2)
+      throw std::runtime_error("test_array_pool");
+}
+
+template <class P>
+void test_geometric()
+{
+  using strg_type = rt::node_storage<unsigned, unsigned, 4, P>;
+  using pointer = typename strg_type::pointer;
+  strg_type strg;
+
+  std::vector<pointer> v;
+  for (unsigned i = 0; i < 1000; ++i) {
+    v.push_back(strg.pop());
+    *v.back() = i;
+  }
+
+  // Block k holds 4 << k nodes, the null node aside.
+  if (strg.get_n_blocks() != 8 || strg.capacity() != 1019
+      || strg.stats().bytes != 1020 * sizeof (unsigned))
+    throw std::runtime_error("test_geometric: 1");
+
+  std::vector<unsigned> idx;
+  for (unsigned i = 0; i < v.size(); ++i) {
+    if (*v[i] != i)
+      throw std::runtime_error("test_geometric: 2");
+    idx.push_back(v[i].get_link().get_idx());
+  }
+  std::sort(std::begin(idx), std::end(idx));
+  if (std::adjacent_find(std::begin(idx), std::end(idx)) != std::end(idx))
+    throw std::runtime_error("test_geometric: 3");
+
+  // Nodes of a block are adjacent, also across the 8 nodes of block 1
+  // and the 512 of block 7.
+  for (unsigned i : {4, 10, 508, 1018})
+    if (&*pointer(&strg, i + 1) != &*pointer(&strg, i) + 1)
+      throw std::runtime_error("test_geometric: 4");
+
+  // Only the first block keeps nodes in use.
+  for (unsigned i = 3; i < v.size(); ++i)
+    strg.push(v[i]);
+  if (strg.shrink_to_fit() != 7 || strg.get_n_blocks() != 1)
+    throw std::runtime_error("test_geometric: 5");
+
+  // The blocks grow again to the same sizes.
+  for (unsigned i = 3; i < v.size(); ++i)
+    v[i] = strg.pop();
+  if (strg.get_n_blocks() != 8 || strg.capacity() != 1019)
+    throw std::runtime_error("test_geometric: 6");
+  for (unsigned i = 0; i < 3; ++i)
+    if (*v[i] != i)
+      throw std::runtime_error("test_geometric: 7");
+
+  for (auto p : v)
+    strg.push(p);
+}
+
+struct concurrent_geometric_policy : rt::concurrent_policy {
+  static constexpr bool geometric = true;
+};
+
+struct contiguous_geometric_policy : rt::contiguous_policy {
+  static constexpr bool geometric = true;
+};
+
+// Nodes given back are not reused.
+void test_monotonic()
+{
+  rt::node_storage<unsigned, unsigned, 4, rt::monotonic_policy> strg;
+  auto p1 = strg.pop();
+  auto p2 = strg.pop();
+  strg.push(p1);
+  strg.push(p2);
+  if (strg.pop().get_link().get_idx() != 3)
+    throw std::runtime_error("test_monotonic: 1");
+  if (strg.pop().get_link().get_idx() != 4 || strg.get_n_blocks() != 2)
+    throw std::runtime_error("test_monotonic: 2");
+}
+
+template <class P>
+void test_release()
+{
+  rt::node_storage<unsigned, unsigned, 4, P> strg;
+  for (unsigned i = 0; i < 10; ++i)
+    *strg.pop() = i;
+  strg.push(typename decltype(strg)::pointer(&strg, 5));
+
+  strg.release();
+  if (strg.get_n_blocks() != 0 || strg.capacity() != 0)
+    throw std::runtime_error("test_release: 1");
+
+  // The storage starts over.
+  if (strg.pop().get_link().get_idx() != 1 || strg.get_n_blocks() != 1)
+    throw std::runtime_error("test_release: 2");
+}
+
+// Released nodes are not reused while a reader that started before
+// could see them.
+void test_epochs()
+{
+  using Node = typename rt::set<unsigned>::node_type;
+  using alloc_type =
+    rt::node_allocator< unsigned, Node, unsigned, 64
+                      , std::allocator<unsigned>, rt::epoch_policy>;
+  using inner_type =
+    typename alloc_type::template rebind<alloc_type::node_type>::other;
+  using pointer = typename inner_type::pointer;
+
+  // Cached or retired nodes would be moved as if in use.
+  static_assert(!rt::has_compact<inner_type>::value, "");
+
+  inner_type alloc;
+  auto r = alloc.reader();
+  auto p = alloc.allocate_node();
+  {
+    rt::epoch_guard<decltype(r)> g(r);
+    alloc.deallocate_node(p);
+    // The first advance is allowed as the reader is in the current
+    // epoch, the second is not.
+    if (alloc.reclaim() != 0 || alloc.reclaim() != 0)
+      throw std::runtime_error("test_epochs: 1");
+  }
+  if (alloc.reclaim() != 1 || alloc.allocate_node() != p)
+    throw std::runtime_error("test_epochs: 2");
+
+  // A writer replaces the published node while readers check that
+  // the node they read does not change under them.
+  constexpr unsigned n_readers = 3;
+  constexpr unsigned n_writes = 20000;
+  auto q = alloc.allocate_node();
+  q->key = 0;
+  std::atomic<unsigned> published {q.get_link().get_idx()};
+  std::atomic<bool> done {false};
+  std::vector<int> errors(n_readers, 0);
+  auto* strg = alloc.get_node_storage().get();
+
+  auto read = [&](unsigned id)
+  {
+    auto rd = alloc.reader();
+    while (!done.load()) {
+      rt::epoch_guard<decltype(rd)> g(rd);
+      const pointer p(strg, published.load(std::memory_order_acquire));
+      const auto k = p->key;
+      for (int i = 0; i < 100; ++i)
+        if (p->key != k)
+          ++errors[id];
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < n_readers; ++i)
+    threads.emplace_back(read, i);
+
+  for (unsigned i = 1; i <= n_writes; ++i) {
+    auto w = alloc.allocate_node();
+    w->key = i;
+    const auto old = published.exchange( w.get_link().get_idx()
+                                       , std::memory_order_acq_rel);
+    alloc.deallocate_node(pointer(strg, old));
+  }
+  done = true;
+
+  for (auto& t : threads)
+    t.join();
+
+  if (std::any_of(std::begin(errors), std::end(errors),
+                  [](int e){ return e != 0; }))
+    throw std::runtime_error("test_epochs: 3");
+
+  // Nodes were reused, the storage did not grow with every write.
+  alloc.reclaim();
+  alloc.reclaim();
+  if (alloc.get_n_blocks() * 64 >= n_writes)
+    throw std::runtime_error("test_epochs: 4");
+}
+
+// The nodes and the free list of a storage survive it in its file.
+void test_persistent()
+{
+  using strg_type =
+    rt::node_storage<unsigned, unsigned, 16, rt::persistent_policy>;
+  const char* path = "rt_node_stack.dat";
+  std::remove(path);
+
+  std::vector<unsigned> idx;
+  {
+    strg_type strg(rt::file_provider{path});
+    for (unsigned i = 0; i < 40; ++i) {
+      auto p = strg.pop();
+      *p = i * i;
+      idx.push_back(p.get_link().get_idx());
+    }
+    for (unsigned i = 1; i < 40; i += 2)
+      strg.push(strg_type::pointer(&strg, idx[i]));
+    strg.set_root(strg_type::pointer(&strg, idx[4]));
+  }
+
+  {
+    strg_type strg(rt::file_provider{path});
+    if (strg.get_root().get_link().get_idx() != idx[4] ||
+        strg.get_n_blocks() != 3)
+      throw std::runtime_error("test_persistent: 1");
+
+    for (unsigned i = 0; i < 40; i += 2)
+      if (*strg_type::pointer(&strg, idx[i]) != i * i)
+        throw std::runtime_error("test_persistent: 2");
+
+    if (strg.pop().get_link().get_idx() != idx[39])
+      throw std::runtime_error("test_persistent: 3");
+
+    // Empty blocks before one in use stay in the file.
+    strg.push(strg_type::pointer(&strg, idx[39]));
+    for (unsigned i = 2; i < 38; i += 2)
+      strg.push(strg_type::pointer(&strg, idx[i]));
+    if (strg.shrink_to_fit() != 0 || strg.get_n_blocks() != 3)
+      throw std::runtime_error("test_persistent: 4");
+
+    strg.push(strg_type::pointer(&strg, idx[38]));
+    if (strg.shrink_to_fit() != 2 || strg.get_n_blocks() != 1)
+      throw std::runtime_error("test_persistent: 5");
+  }
+
+  {
+    strg_type strg(rt::file_provider{path});
+    if (strg.get_n_blocks() != 1 ||
+        *strg_type::pointer(&strg, idx[0]) != 0)
+      throw std::runtime_error("test_persistent: 6");
+  }
+
+  // The file of a storage of another node type is refused.
+  bool thrown = false;
+  try {
+    rt::node_storage< unsigned long long, unsigned, 16
+                    , rt::persistent_policy> s(rt::file_provider{path});
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw std::runtime_error("test_persistent: 7");
+
+  std::remove(path);
+}
+
+// Each thread binds its own storage of the same type.
+void test_thread_bound()
+{
+  using strg_type =
+    rt::node_storage<unsigned, unsigned, 8, rt::thread_bound_policy>;
+  using pointer = typename strg_type::pointer;
+
+  std::vector<int> errors(4, 0);
+  auto func = [&](unsigned id)
+  {
+    strg_type strg;
+    std::vector<pointer> v;
+    for (unsigned i = 0; i < 100; ++i) {
+      v.push_back(strg.pop());
+      *v.back() = id;
+    }
+    for (auto p : v)
+      if (*p != id || p.get_strg() != &strg)
+        ++errors[id];
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < errors.size(); ++i)
+    threads.emplace_back(func, i);
+
+  for (auto& th : threads)
+    th.join();
+
+  for (auto e : errors)
+    if (e != 0)
+      throw std::runtime_error("test_thread_bound");
+
+  if (strg_type::get_bound())
+    throw std::runtime_error("test_thread_bound");
 }
 
-template <class T, class L>
+template <class T, class L, class P = rt::storage_policy>
 void test_node_storage()
 {
   constexpr unsigned N = 4;
 
-  rt::node_storage<T, L, N> strg;
+  rt::node_storage<T, L, N, P> strg;
 
   // Initially there must be zero blocks.
   if (strg.get_n_blocks() != 0)
@@ -112,6 +747,455 @@ void test_node_storage()
     throw std::runtime_error("pop: 2");
 }
 
+template <class P>
+void test_pop_n()
+{
+  rt::node_storage<unsigned, unsigned, 8, P> strg;
+
+  auto idx = [](auto p) { return p.get_link().get_idx(); };
+
+  // The first run is carved out of a new block and skips the null
+  // index. The rest of the block is left fresh.
+  auto r1 = strg.pop_n(5);
+  if (idx(r1.first) != 1 || idx(r1.second) != 6)
+    throw std::runtime_error("pop_n: 1");
+
+  // What is left of the block.
+  auto r2 = strg.pop_n(5);
+  if (idx(r2.first) != 6 || idx(r2.second) != 8)
+    throw std::runtime_error("pop_n: 2");
+
+  // Releases the first run at once.
+  for (auto p = r1.first; idx(p) != 5; ++p) {
+    auto q = p;
+    strg.link(p, ++q);
+  }
+  auto last = r1.first;
+  last = 5;
+  strg.push_chain(r1.first, last);
+
+  // As the free list is not empty, we get a single node.
+  auto r3 = strg.pop_n(5);
+  if (idx(r3.first) != 1 || idx(r3.second) != 2)
+    throw std::runtime_error("pop_n: 3");
+
+  for (unsigned i : {2, 3, 4, 5})
+    if (idx(strg.pop()) != i)
+      throw std::runtime_error("push_chain");
+
+  if (strg.get_n_blocks() != 1)
+    throw std::runtime_error("push_chain");
+
+  // With the free list empty, a new block is used.
+  auto r4 = strg.pop_n(20);
+  if (idx(r4.first) != 8 || idx(r4.second) != 16)
+    throw std::runtime_error("pop_n: 4");
+
+  if (strg.get_n_blocks() != 2)
+    throw std::runtime_error("pop_n: 4");
+
+  // The run took the whole block, so a third one is added.
+  auto p = strg.pop();
+  auto r5 = strg.pop_n(3);
+  if (idx(p) != 16 || idx(r5.first) != 17 || idx(r5.second) != 20)
+    throw std::runtime_error("pop_n: 5");
+
+  strg.push(p);
+  for (; r5.first != r5.second; ++r5.first)
+    strg.push(r5.first);
+  for (; r4.first != r4.second; ++r4.first)
+    strg.push(r4.first);
+
+  // Fresh nodes of the third block count as free ones.
+  if (strg.shrink_to_fit() != 2 || strg.get_n_blocks() != 1)
+    throw std::runtime_error("pop_n: 6");
+}
+
+template <class P>
+void test_shrink_to_fit()
+{
+  using strg_type = rt::node_storage<unsigned, unsigned, 4, P>;
+  using pointer = typename strg_type::pointer;
+  strg_type strg;
+
+  // Fills three blocks, the first has only three nodes.
+  std::vector<pointer> v;
+  for (unsigned i = 1; i < 12; ++i) {
+    v.push_back(strg.pop());
+    *v.back() = i;
+  }
+
+  if (strg.shrink_to_fit() != 0)
+    throw std::runtime_error("shrink_to_fit: 1");
+
+  // Frees the second block and one node of the first.
+  strg.push(v[1]);
+  for (unsigned i = 3; i < 7; ++i)
+    strg.push(v[i]);
+
+  if (strg.shrink_to_fit() != 1 || strg.get_n_blocks() != 3)
+    throw std::runtime_error("shrink_to_fit: 2");
+
+  // The free node of the first block is kept and the released slot
+  // is reused.
+  v[1] = strg.pop();
+  v[3] = strg.pop();
+  if (v[1].get_link().get_idx() != 2 || v[3].get_link().get_idx() != 4)
+    throw std::runtime_error("shrink_to_fit: 3");
+
+  if (strg.get_n_blocks() != 3)
+    throw std::runtime_error("shrink_to_fit: 3");
+
+  // Trailing blocks leave the table.
+  strg.push(v[3]);
+  for (unsigned i = 7; i < 11; ++i)
+    strg.push(v[i]);
+
+  if (strg.shrink_to_fit() != 2 || strg.get_n_blocks() != 1)
+    throw std::runtime_error("shrink_to_fit: 4");
+
+  if (*v[0] != 1 || *v[2] != 3)
+    throw std::runtime_error("shrink_to_fit: 5");
+
+  for (unsigned i = 0; i < 3; ++i)
+    strg.push(v[i]);
+
+  if (strg.shrink_to_fit() != 1 || strg.get_n_blocks() != 0)
+    throw std::runtime_error("shrink_to_fit: 6");
+
+  if (strg.pop().get_link().get_idx() != 1)
+    throw std::runtime_error("shrink_to_fit: 7");
+}
+
+// Keeps track of the bytes it has handed out.
+template <class T>
+struct counting_alloc {
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  template <class U>
+  struct rebind { using other = counting_alloc<U>; };
+  static std::size_t bytes;
+
+  counting_alloc() = default;
+  template <class U>
+  counting_alloc(const counting_alloc<U>&) {}
+
+  T* allocate(std::size_t n, const T* = 0)
+  {
+    bytes += n * sizeof (T);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, std::size_t n)
+  {
+    bytes -= n * sizeof (T);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  bool operator==(const counting_alloc&) const { return true; }
+  bool operator!=(const counting_alloc&) const { return false; }
+};
+
+template <class T>
+std::size_t counting_alloc<T>::bytes = 0;
+
+// Pops n nodes, checks what was written on them and releases them.
+template <class S>
+void use_storage(S& strg, unsigned n)
+{
+  std::vector<typename S::pointer> v;
+  for (unsigned i = 0; i < n; ++i) {
+    v.push_back(strg.pop());
+    *v.back() = i;
+  }
+
+  for (unsigned i = 0; i < n; ++i) {
+    if (*v[i] != i)
+      throw std::runtime_error("use_storage");
+    strg.push(v[i]);
+  }
+}
+
+struct arena_policy : rt::storage_policy {
+  using provider = rt::arena_provider;
+};
+
+void test_block_provider()
+{
+  {
+    using P = rt::upstream_policy<counting_alloc<char>>;
+    using A = rt::node_allocator< unsigned, rt::set<unsigned>::node_type
+                                , unsigned, 8, counting_alloc<unsigned>
+                                , P>;
+    rt::set<unsigned, std::less<unsigned>, A> s {3, 1, 2, 5, 4};
+    if (counting_alloc<char>::bytes == 0)
+      throw std::runtime_error("test_block_provider: upstream");
+  }
+  if (counting_alloc<char>::bytes != 0)
+    throw std::runtime_error("test_block_provider: upstream");
+
+  alignas (std::max_align_t) char buf[256];
+  rt::arena ar(buf, sizeof buf);
+  {
+    rt::node_storage<unsigned, unsigned, 8, arena_policy> strg(ar);
+    use_storage(strg, 20);
+    // Three blocks of eight nodes.
+    if (ar.get_used() != 96)
+      throw std::runtime_error("test_block_provider: arena");
+
+    bool thrown = false;
+    try {
+      use_storage(strg, 100);
+    } catch (const std::bad_alloc&) {
+      thrown = true;
+    }
+    if (!thrown)
+      throw std::runtime_error("test_block_provider: arena");
+  }
+
+  {
+    // Blocks of 2MB, huge pages may not be available.
+    rt::node_storage< unsigned, unsigned, 1 << 19
+                    , rt::huge_page_policy> strg;
+    use_storage(strg, 1000);
+    if (strg.shrink_to_fit() != 1)
+      throw std::runtime_error("test_block_provider: mmap");
+  }
+
+  {
+    struct P : rt::storage_policy {
+      using provider = rt::mmap_provider<rt::mmap_populate>;
+    };
+    rt::node_storage<unsigned, unsigned, 64, P> strg;
+    use_storage(strg, 1000);
+  }
+}
+
+void test_contiguous()
+{
+  using P = rt::contiguous_policy;
+  using strg_type = rt::node_storage<unsigned, unsigned, 1024, P>;
+  strg_type strg(rt::vm_provider(1 << 16));
+
+  // Each block is 4096 bytes so there is room for 16 of them.
+  use_storage(strg, 1000);
+  auto p = strg.pop();
+  const auto* base = &*p - p.get_link().get_idx();
+  std::vector<strg_type::pointer> v;
+  for (unsigned i = 0; i < 10000; ++i) {
+    v.push_back(strg.pop());
+    if (&*v.back() != base + v.back().get_link().get_idx())
+      throw std::runtime_error("test_contiguous: 1");
+    *v.back() = i;
+  }
+
+  bool thrown = false;
+  try {
+    use_storage(strg, 10000);
+  } catch (const std::bad_alloc&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw std::runtime_error("test_contiguous: 2");
+
+  for (unsigned i = 0; i < 10000; ++i)
+    if (*v[i] != i)
+      throw std::runtime_error("test_contiguous: 3");
+
+  // Released blocks are committed again in place.
+  for (auto q : v)
+    strg.push(q);
+  if (strg.shrink_to_fit() == 0)
+    throw std::runtime_error("test_contiguous: 4");
+  use_storage(strg, 10000);
+}
+
+template <class P>
+struct counted_fixed_policy : P {
+  static constexpr bool fixed = true;
+  static int n_exhausted;
+  static void exhausted() { ++n_exhausted; }
+};
+
+template <class P>
+int counted_fixed_policy<P>::n_exhausted = 0;
+
+template <class P>
+void test_fixed()
+{
+  using policy = counted_fixed_policy<P>;
+  rt::node_storage<unsigned, unsigned, 4, policy> strg;
+
+  if (strg.pop() || policy::n_exhausted != 1)
+    throw std::runtime_error("test_fixed: 1");
+
+  // The first block has only three nodes.
+  strg.reserve(10);
+  if (strg.capacity() != 11 || strg.get_n_blocks() != 3)
+    throw std::runtime_error("test_fixed: 2");
+
+  unsigned idx[8];
+  if (strg.pop(idx, 8) != 8)
+    throw std::runtime_error("test_fixed: 3");
+
+  auto p = strg.pop();
+  if (strg.pop(idx, 8) != 2 || strg.get_n_blocks() != 3)
+    throw std::runtime_error("test_fixed: 4");
+
+  auto r = strg.pop_n(4);
+  if (r.first || r.first != r.second || policy::n_exhausted != 2)
+    throw std::runtime_error("test_fixed: 5");
+
+  strg.push(p);
+  if (strg.pop() != p)
+    throw std::runtime_error("test_fixed: 6");
+
+  strg.reserve(12);
+  if (strg.capacity() != 15 || !strg.pop())
+    throw std::runtime_error("test_fixed: 7");
+
+  rt::node_storage<unsigned char, unsigned char, 4> small;
+  bool thrown = false;
+  try {
+    small.reserve(256);
+  } catch (const std::length_error&) {
+    thrown = true;
+  }
+  if (!thrown || small.get_n_blocks() != 0)
+    throw std::runtime_error("test_fixed: 8");
+}
+
+void test_concurrent_storage()
+{
+  // Each thread writes its id in the nodes it owns and checks
+  // nobody else has written on them before releasing. The id is
+  // kept out of the first word, that a thread popping concurrently
+  // may still read as a link, see node_storage::pop.
+  using node_type = std::array<unsigned, 2>;
+  using strg_type =
+    rt::node_storage<node_type, unsigned, 64, rt::concurrent_policy>;
+  using pointer = typename strg_type::pointer;
+
+  constexpr unsigned n_threads = 4;
+  constexpr unsigned n_nodes = 1000;
+  constexpr unsigned repeat = 200;
+
+  strg_type strg;
+  std::vector<int> errors(n_threads, 0);
+
+  auto func = [&](unsigned id)
+  {
+    std::vector<pointer> v(n_nodes);
+    for (unsigned r = 0; r < repeat; ++r) {
+      for (auto& p : v) {
+        p = strg.pop();
+        (*p)[1] = id;
+      }
+      for (auto& p : v) {
+        if ((*p)[1] != id)
+          ++errors[id];
+        strg.push(p);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < n_threads; ++i)
+    threads.emplace_back(func, i);
+
+  for (auto& t : threads)
+    t.join();
+
+  if (std::any_of(std::begin(errors), std::end(errors),
+                  [](int e){ return e != 0; }))
+    throw std::runtime_error("test_concurrent_storage");
+
+  // All nodes have been returned, so at most enough blocks for
+  // all threads at the same time may have been allocated.
+  const auto max_blocks = (n_threads * n_nodes) / 64 + n_threads + 1;
+  if (strg.get_n_blocks() > max_blocks)
+    throw std::runtime_error("test_concurrent_storage");
+
+  // And every node must be handed out only once.
+  std::vector<unsigned> idxs;
+  for (std::size_t i = 1; i < strg.get_n_blocks() * 64; ++i)
+    idxs.push_back(strg.pop().get_link().get_idx());
+
+  std::sort(std::begin(idxs), std::end(idxs));
+  if (std::adjacent_find(std::begin(idxs), std::end(idxs))
+      != std::end(idxs))
+    throw std::runtime_error("test_concurrent_storage");
+}
+
+void test_magazine()
+{
+  using Node = typename rt::set<unsigned>::node_type;
+  using alloc_type =
+    rt::node_allocator< unsigned, Node, unsigned, 64
+                      , std::allocator<unsigned>, rt::cached_policy>;
+  using inner_type =
+    typename alloc_type::template rebind<alloc_type::node_type>::other;
+  using pointer = typename inner_type::pointer;
+
+  // Cached or retired nodes would be moved as if in use.
+  static_assert(!rt::has_compact<inner_type>::value, "");
+
+  constexpr unsigned n_threads = 4;
+  constexpr unsigned n_nodes = 1000;
+  constexpr unsigned repeat = 100;
+
+  inner_type alloc;
+  std::vector<int> errors(n_threads, 0);
+
+  auto func = [&](unsigned id)
+  {
+    inner_type a(alloc);
+    std::vector<pointer> v(n_nodes);
+    for (unsigned r = 0; r < repeat; ++r) {
+      for (auto& p : v) {
+        p = a.allocate_node();
+        p->key = id;
+      }
+      for (auto& p : v) {
+        if (p->key != id)
+          ++errors[id];
+        a.deallocate_node(p);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < n_threads; ++i)
+    threads.emplace_back(func, i);
+
+  for (auto& t : threads)
+    t.join();
+
+  if (std::any_of(std::begin(errors), std::end(errors),
+                  [](int e){ return e != 0; }))
+    throw std::runtime_error("test_magazine");
+
+  // Threads that exited must have returned their cached nodes.
+  const auto refills = alloc.get_n_refills();
+  const auto flushes = alloc.get_n_flushes();
+  if (refills == 0 || flushes == 0)
+    throw std::runtime_error("test_magazine");
+
+  // Batches are half a magazine.
+  const auto r = rt::cached_policy::magazine / 2;
+  if (refills > repeat * n_threads * (n_nodes / r + 1))
+    throw std::runtime_error("test_magazine");
+
+  auto p = alloc.allocate_node();
+  alloc.deallocate_node(p);
+  alloc.flush();
+  if (alloc.get_n_flushes() != flushes + 1)
+    throw std::runtime_error("test_magazine");
+}
+
 void test_node_ptr()
 {
   rt::node_storage<unsigned, unsigned, 4> a;
@@ -272,6 +1356,56 @@ int main()
     test_node_storage<unsigned char         , unsigned long long int>();
     test_node_storage<unsigned long long int, unsigned char>();
 
+    using CP = rt::concurrent_policy;
+    test_node_storage<unsigned char , unsigned char , CP>();
+    test_node_storage<unsigned short, unsigned short, CP>();
+    test_node_storage<unsigned int  , unsigned int  , CP>();
+    test_node_storage<unsigned long long int, unsigned int, CP>();
+    test_pop_n<rt::storage_policy>();
+    test_pop_n<rt::concurrent_policy>();
+    test_shrink_to_fit<rt::storage_policy>();
+    test_shrink_to_fit<rt::concurrent_policy>();
+    test_block_provider();
+    test_fixed<rt::storage_policy>();
+    test_fixed<rt::concurrent_policy>();
+    test_node_storage<unsigned, unsigned, rt::contiguous_policy>();
+    test_shrink_to_fit<rt::contiguous_policy>();
+    test_contiguous();
+    test_node_storage<unsigned, unsigned, rt::bound_policy>();
+    test_node_storage<unsigned, unsigned char, rt::thread_bound_policy>();
+    test_shrink_to_fit<rt::bound_policy>();
+    test_thread_bound();
+    test_occupancy<4>();
+    test_occupancy<128>();
+    test_compact<rt::storage_policy>();
+    test_compact<rt::concurrent_policy>();
+    test_compact<rt::contiguous_policy>();
+    test_compact<rt::occupancy_policy>();
+    test_bit_tree();
+    test_address_ordered();
+    using AP = rt::address_ordered_policy;
+    test_shrink_to_fit<AP>();
+    test_fixed<AP>();
+    test_compact<AP>();
+    test_stats<rt::storage_policy>();
+    test_stats<rt::concurrent_policy>();
+    test_stats<rt::address_ordered_policy>();
+    test_persistent();
+    test_array_pool<rt::pooled_policy>();
+    test_array_pool<concurrent_pooled_policy>();
+    test_geometric<rt::geometric_policy>();
+    test_geometric<concurrent_geometric_policy>();
+    test_geometric<contiguous_geometric_policy>();
+    test_compact<rt::geometric_policy>();
+    test_monotonic();
+    test_release<rt::storage_policy>();
+    test_release<rt::concurrent_policy>();
+    test_release<rt::monotonic_policy>();
+    test_release<rt::geometric_policy>();
+    test_concurrent_storage();
+    test_magazine();
+    test_epochs();
+
     test_node_ptr();
     test_node_ptr_type();
     test_node();
@@ -1,3 +1,7 @@
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
 #include <iostream>
 #include <set>
 #include <iterator>
@@ -8,12 +12,18 @@
 #include <limits>
 #include <array>
 #include <vector>
+#include <memory>
+#include <numeric>
 
 #include <rtcpp/container/set.hpp>
+#include <rtcpp/container/frozen_set.hpp>
 #include <rtcpp/memory/node_allocator.hpp>
 #include <rtcpp/utility/make_rand_data.hpp>
 #include <rtcpp/utility/print.hpp>
 
+#include <unistd.h>
+#include <sys/wait.h>
+
 template <class A>
 void test_move()
 {
@@ -183,6 +193,704 @@ void test_basic(const std::vector<int>& tmp)
     throw std::runtime_error("test_basic");
 }
 
+void test_fixed()
+{
+  using Node = rt::set<int>::node_type;
+  using A = rt::node_allocator< int, Node, unsigned, 4
+                              , std::allocator<int>, rt::fixed_policy>;
+  A a;
+  a.reserve(7); // Two blocks, the head node takes one of them.
+  rt::set<int, std::less<int>, A> t1(a);
+
+  const std::vector<int> v {5, 3, 7, 1, 2, 6, 4, 8};
+  t1.insert(std::begin(v), std::end(v));
+  if (t1.size() != 6 || a.get_n_blocks() != 2)
+    throw std::runtime_error("test_fixed: 1");
+
+  if (t1.insert(9).second || t1.size() != 6)
+    throw std::runtime_error("test_fixed: 2");
+
+  t1.erase(5);
+  if (!t1.insert(9).second || t1.size() != 6)
+    throw std::runtime_error("test_fixed: 3");
+}
+
+void test_compact()
+{
+  using Node = rt::set<int>::node_type;
+  using A = rt::node_allocator<int, Node, unsigned, 16>;
+  using set_type = rt::set<int, std::less<int>, A>;
+
+  std::vector<int> data;
+  for (int i = 0; i < 500; ++i)
+    data.push_back((i * 7919) % 500);
+
+  set_type t1(std::begin(data), std::end(data));
+  for (int i = 0; i < 500; ++i)
+    if (i % 8 != 0)
+      t1.erase(data[i]);
+
+  std::set<int> expected;
+  for (int i = 0; i < 500; i += 8)
+    expected.insert(data[i]);
+
+  const auto strg = t1.get_allocator().get_node_storage();
+  const auto blocks = strg->get_n_blocks();
+  if (t1.compact() == 0 || strg->get_n_blocks() >= blocks)
+    throw std::runtime_error("test_compact: 1");
+
+  if (!std::equal( std::begin(t1), std::end(t1), std::begin(expected)
+                 , std::end(expected)))
+    throw std::runtime_error("test_compact: 2");
+
+  // The tree is still usable in both directions.
+  t1.insert(1000);
+  t1.erase(*std::begin(expected));
+  expected.insert(1000);
+  expected.erase(std::begin(expected));
+  if (!std::equal( t1.rbegin(), t1.rend(), expected.rbegin()
+                 , expected.rend()))
+    throw std::runtime_error("test_compact: 3");
+
+  // Allocators without node storage move nothing.
+  rt::set<int> t2 {3, 1, 2};
+  if (t2.compact() != 0 || t2.size() != 3)
+    throw std::runtime_error("test_compact: 4");
+}
+
+struct monotonic_stats_policy : rt::monotonic_policy {
+  static constexpr bool statistics = true;
+};
+
+// Sets whose nodes the allocator drops on its own are destroyed
+// without visiting them, unless their elements have a destructor.
+void test_drop_nodes()
+{
+  using Node = rt::set<int>::node_type;
+  using A1 = rt::node_allocator< int, Node, unsigned, 16
+                               , std::allocator<int>
+                               , rt::statistics_policy>;
+  using A2 = rt::node_allocator< int, Node, unsigned, 16
+                               , std::allocator<int>
+                               , monotonic_stats_policy>;
+  using set1_type = rt::set<int, std::less<int>, A1>;
+  using set2_type = rt::set<int, std::less<int>, A2>;
+  std::vector<int> data;
+  for (int i = 0; i < 100; ++i)
+    data.push_back((i * 37) % 100);
+
+  // The storage outlives the set, the nodes are released.
+  A1 a1;
+  {
+    set1_type t(std::begin(data), std::end(data), a1);
+  }
+  if (a1.stats().live != 0)
+    throw std::runtime_error("test_drop_nodes: 1");
+
+  // Only the erased nodes are released.
+  A2 a2;
+  {
+    set2_type t(std::begin(data), std::end(data), a2);
+    for (int i = 0; i < 10; ++i)
+      t.erase(i);
+  }
+  const auto s = a2.stats();
+  if (s.frees != 10 || s.live != 91)
+    throw std::runtime_error("test_drop_nodes: 2");
+
+  a2.release();
+  if (a2.get_n_blocks() != 0)
+    throw std::runtime_error("test_drop_nodes: 3");
+
+  // Elements with a destructor are destroyed.
+  using key_type = std::shared_ptr<int>;
+  using Node3 = rt::set<key_type>::node_type;
+  using A3 = rt::node_allocator< key_type, Node3, unsigned, 16
+                               , std::allocator<key_type>
+                               , rt::monotonic_policy>;
+  auto k = std::make_shared<int>(1);
+  {
+    rt::set<key_type, std::less<key_type>, A3> t {k};
+  }
+  if (k.use_count() != 1)
+    throw std::runtime_error("test_drop_nodes: 4");
+}
+
+// A set left in its file is reloaded as it was.
+void test_persistent()
+{
+  using Node = rt::set<int>::node_type;
+  using A = rt::node_allocator< int, Node, unsigned, 64
+                              , std::allocator<int>
+                              , rt::persistent_policy>;
+  using set_type = rt::set<int, std::less<int>, A>;
+  const char* path = "rt_set.dat";
+  std::remove(path);
+
+  std::set<int> expected;
+  {
+    A alloc(rt::file_provider{path});
+    set_type t1(alloc);
+    for (int i = 0; i < 1000; ++i) {
+      t1.insert((i * 7) % 1000);
+      expected.insert((i * 7) % 1000);
+    }
+    t1.persist();
+    set_type t2({-1, -2, -3}, alloc); // Released as usual.
+  }
+
+  {
+    A alloc(rt::file_provider{path});
+    set_type t1(rt::from_root, alloc);
+    if (!std::equal( std::begin(t1), std::end(t1), std::begin(expected)
+                   , std::end(expected)))
+      throw std::runtime_error("test_persistent: 1");
+
+    for (int i = 0; i < 1000; i += 3) {
+      t1.erase(i);
+      expected.erase(i);
+    }
+    t1.insert(5000);
+    expected.insert(5000);
+  }
+
+  {
+    A alloc(rt::file_provider{path});
+    set_type t1(rt::from_root, alloc);
+    t1.compact();
+    if (!std::equal( std::begin(t1), std::end(t1), std::begin(expected)
+                   , std::end(expected)))
+      throw std::runtime_error("test_persistent: 2");
+  }
+
+  {
+    A alloc(rt::file_provider{path});
+    set_type t1(rt::from_root, alloc);
+    if (!std::equal( t1.rbegin(), t1.rend(), expected.rbegin()
+                   , expected.rend()))
+      throw std::runtime_error("test_persistent: 3");
+  }
+  std::remove(path);
+
+  // A new file has no root yet.
+  {
+    A alloc(rt::file_provider{path});
+    set_type t1(rt::from_root, alloc);
+    if (!t1.empty() || t1.begin() != t1.end())
+      throw std::runtime_error("test_persistent: 4");
+    for (int k : {3, 1, 2})
+      t1.insert(k);
+  }
+
+  {
+    A alloc(rt::file_provider{path});
+    set_type t1(rt::from_root, alloc);
+    if (t1.size() != 3 || *t1.begin() != 1 || *t1.rbegin() != 3)
+      throw std::runtime_error("test_persistent: 5");
+  }
+
+  std::remove(path);
+}
+
+// A child process attaches to a set built in shared memory.
+void test_shared()
+{
+  using Node = rt::set<int>::node_type;
+  using A = rt::node_allocator< int, Node, unsigned, 64
+                              , std::allocator<int>, rt::shared_policy>;
+  using set_type = rt::set<int, std::less<int>, A>;
+  const auto name = "/rt_set_" + std::to_string(::getpid());
+  rt::shm_provider::remove(name);
+
+  std::set<int> expected;
+  A alloc(rt::shm_provider{name});
+  set_type t1(alloc);
+  for (int i = 0; i < 500; ++i) {
+    t1.insert((i * 13) % 500);
+    expected.insert((i * 13) % 500);
+  }
+  t1.persist();
+  alloc.sync();
+
+  const auto pid = ::fork();
+  if (pid == 0) {
+    bool ok = false;
+    {
+      A a(rt::shm_provider{name});
+      set_type t2(rt::from_root, a);
+      ok = std::equal( std::begin(t2), std::end(t2)
+                     , std::begin(expected), std::end(expected));
+    }
+    ::_exit(ok ? 0 : 1);
+  }
+
+  int status = 1;
+  ::waitpid(pid, &status, 0);
+  rt::shm_provider::remove(name);
+  if (pid == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    throw std::runtime_error("test_shared");
+}
+
+// Two sets whose pointers are bound to their storage by a tag.
+void test_bound()
+{
+  struct tag1 : rt::bound_policy {};
+  struct tag2 : rt::bound_policy {};
+  using Node = rt::set<int>::node_type;
+  using A1 = rt::node_allocator< int, Node, unsigned, 128
+                               , std::allocator<int>, tag1>;
+  using A2 = rt::node_allocator< int, Node, unsigned short, 128
+                               , std::allocator<int>, tag2>;
+  using set1 = rt::set<int, std::less<int>, A1>;
+  using set2 = rt::set<int, std::less<int>, A2>;
+
+  static_assert((sizeof (set1::iterator) == sizeof (unsigned)), "");
+
+  const std::vector<int> v {5, 3, 7, 1, 2, 6, 4, 8};
+  set1 t1(std::begin(v), std::end(v));
+  set2 t2 {10, 20, 30};
+  t1.erase(3);
+  t2.insert(15);
+
+  if (!std::equal(std::begin(t1), std::end(t1),
+                  std::begin(std::vector<int>{1, 2, 4, 5, 6, 7, 8})))
+    throw std::runtime_error("test_bound: 1");
+
+  if (t2.size() != 4 || t2.count(15) != 1 || t1.count(15) != 0)
+    throw std::runtime_error("test_bound: 2");
+
+  set1 t3(t1);
+  if (t3 != t1)
+    throw std::runtime_error("test_bound: 3");
+
+  // Moves and results that bring no storage of their own.
+  const std::vector<int> w {1, 2, 4, 5, 6, 7, 8};
+  set1 t4(std::move(t3));
+  if (!std::equal(std::begin(w), std::end(w), std::begin(t4))
+      || t4.count(4) != 1 || t4.size() != w.size())
+    throw std::runtime_error("test_bound: 4");
+
+  set1 t5(t1.get_allocator());
+  t5 = std::move(t4);
+  t5.insert(3);
+  if (t5.size() != 8 || t5.count(3) != 1 || t1.count(3) != 0)
+    throw std::runtime_error("test_bound: 5");
+
+  const set1 t6 {{4, 9}, t1.get_allocator()};
+  const auto u = set_union(t1, t6);
+  const auto i = set_intersection(t1, t6);
+  const auto d = set_difference(t1, t6);
+  if (u.size() != 8 || u.count(9) != 1 || i.size() != 1
+      || i.count(4) != 1 || d.size() != 6 || d.count(4) != 0
+      || d.count(8) != 1)
+    throw std::runtime_error("test_bound: 6");
+}
+
+// Height of the subtree of p, checking the balance of its nodes.
+template <class Ptr>
+int check_avl(Ptr p)
+{
+  int h[2] = {0, 0};
+  auto q = p;
+  if (!p->template get_null_link<0>()) {
+    q = p->link[0];
+    h[0] = check_avl(q);
+  }
+  if (!p->template get_null_link<1>()) {
+    q = p->link[1];
+    h[1] = check_avl(q);
+  }
+  if (h[1] - h[0] != p->get_balance())
+    throw std::runtime_error("check_avl");
+  return 1 + std::max(h[0], h[1]);
+}
+
+template <class Set>
+int avl_height(const Set& t)
+{
+  auto p = t.end().m_p;
+  if (p->template get_null_link<0>())
+    return 0;
+  p = p->link[0];
+  return check_avl(p);
+}
+
+template <class A>
+void test_avl()
+{
+  using set_type = rt::set<int, std::less<int>, A, rt::tbst::avl>;
+
+  // Sorted input, that degenerates the unbalanced tree.
+  const int n = (1 << 12) - 1;
+  std::vector<int> v(n);
+  std::iota(std::begin(v), std::end(v), 0);
+  set_type t1(std::begin(v), std::end(v));
+  if (avl_height(t1) != 12 || t1.size() != v.size())
+    throw std::runtime_error("test_avl: 1");
+  if (!std::equal(std::begin(v), std::end(v), std::begin(t1)))
+    throw std::runtime_error("test_avl: 2");
+
+  for (int i = n - 1; i >= 0; i -= 2)
+    t1.erase(i);
+  if (avl_height(t1) > 12 || t1.size() != v.size() / 2)
+    throw std::runtime_error("test_avl: 3");
+
+  set_type t2(t1);
+  if (t2 != t1 || avl_height(t2) != avl_height(t1))
+    throw std::runtime_error("test_avl: 4");
+
+  // Random inserts and erases checked against std::set.
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> dis(0, 500);
+  std::set<int> ref;
+  set_type t3;
+  for (int i = 0; i < 20000; ++i) {
+    const int k = dis(gen);
+    if (gen() % 2) {
+      if (t3.insert(k).second != ref.insert(k).second)
+        throw std::runtime_error("test_avl: 5");
+    } else if (t3.erase(k) != ref.erase(k)) {
+      throw std::runtime_error("test_avl: 6");
+    }
+    if (i % 1000 == 0)
+      avl_height(t3);
+  }
+  avl_height(t3);
+  if (!std::equal(std::begin(ref), std::end(ref), std::begin(t3))
+      || t3.size() != ref.size())
+    throw std::runtime_error("test_avl: 7");
+  if (!std::equal(ref.rbegin(), ref.rend(), t3.rbegin()))
+    throw std::runtime_error("test_avl: 8");
+
+  for (auto k : ref)
+    t3.erase(k);
+  if (!t3.empty())
+    throw std::runtime_error("test_avl: 9");
+}
+
+template <class A>
+void test_assign_sorted()
+{
+  using set_type = rt::set<int, std::less<int>, A, rt::tbst::avl>;
+
+  for (int n : {0, 1, 2, 3, 100, 1000}) {
+    std::vector<int> v(n);
+    std::iota(std::begin(v), std::end(v), 0);
+    set_type t1 {7, 8};
+    t1.assign_sorted(std::begin(v), std::end(v));
+    if (avl_height(t1) != std::ceil(std::log2(n + 1)))
+      throw std::runtime_error("test_assign_sorted: 1");
+    if (t1.size() != v.size()
+        || !std::equal(std::begin(v), std::end(v), std::begin(t1))
+        || !std::equal(v.rbegin(), v.rend(), t1.rbegin()))
+      throw std::runtime_error("test_assign_sorted: 2");
+    for (int i = 0; i < n; i += 3)
+      t1.erase(i);
+    t1.insert(n + 1);
+    avl_height(t1);
+  }
+
+  // Unsorted ranges are sorted first, the first of equivalent keys
+  // being kept.
+  const std::vector<int> v {5, 3, 7, 3, 1, 2, 9, 5, 0};
+  set_type t2(std::begin(v), std::end(v));
+  const std::set<int> ref(std::begin(v), std::end(v));
+  avl_height(t2);
+  if (!std::equal(std::begin(ref), std::end(ref), std::begin(t2))
+      || t2.size() != ref.size())
+    throw std::runtime_error("test_assign_sorted: 3");
+
+  std::istringstream is("4 2 8 2 6");
+  set_type t3((std::istream_iterator<int>(is)),
+              std::istream_iterator<int>());
+  if (t3 != set_type {2, 4, 6, 8})
+    throw std::runtime_error("test_assign_sorted: 4");
+}
+
+// Nodes of a set built from a range follow each other in memory.
+void test_assign_order()
+{
+  using Node = rt::set<int>::node_type;
+  using A = rt::node_allocator<int, Node, unsigned, 256>;
+  const std::vector<int> v = rt::make_rand_data<int>(1000, 1, 100000);
+  rt::set<int, std::less<int>, A> t1(std::begin(v), std::end(v));
+  std::vector<const int*> addr;
+  for (const auto& k : t1)
+    addr.push_back(&k);
+  if (!std::is_sorted(std::begin(addr), std::end(addr)))
+    throw std::runtime_error("test_assign_order: 1");
+
+  // A fixed size allocator keeps the lowest keys it can hold.
+  using B = rt::node_allocator< int, Node, unsigned, 4
+                              , std::allocator<int>, rt::fixed_policy>;
+  B b;
+  b.reserve(7);
+  rt::set<int, std::less<int>, B> t2(b);
+  const std::vector<int> w {1, 2, 3, 4, 5, 6, 7, 8};
+  t2.assign_sorted(std::begin(w), std::end(w));
+  if (t2.size() != 6 || !std::equal(std::begin(t2), std::end(t2),
+                                    std::begin(w)))
+    throw std::runtime_error("test_assign_order: 2");
+  t2.erase(3);
+  if (!t2.insert(9).second || t2.count(9) != 1)
+    throw std::runtime_error("test_assign_order: 3");
+}
+
+template <class Set>
+void check_ranks(const Set& t, const std::vector<int>& ref)
+{
+  for (std::size_t k = 0; k < ref.size(); ++k)
+    if (*t.nth(k) != ref[k])
+      throw std::runtime_error("check_ranks: 1");
+  if (t.nth(ref.size()) != t.end())
+    throw std::runtime_error("check_ranks: 2");
+  for (int key = -1; key < 502; key += 7) {
+    const auto lb = std::lower_bound(std::begin(ref), std::end(ref), key);
+    if (t.rank(key) != static_cast<std::size_t>(lb - std::begin(ref)))
+      throw std::runtime_error("check_ranks: 3");
+    const auto ub = std::lower_bound(lb, std::end(ref), key + 50);
+    if (t.count_range(key, key + 50) != static_cast<std::size_t>(ub - lb))
+      throw std::runtime_error("check_ranks: 4");
+  }
+}
+
+template <class A>
+void test_ranked()
+{
+  using set_type = rt::set<int, std::less<int>, A, rt::tbst::ranked>;
+
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> dis(0, 500);
+  std::set<int> ref;
+  set_type t1;
+  for (int i = 0; i < 5000; ++i) {
+    const int k = dis(gen);
+    if (gen() % 3) {
+      if (t1.insert(k).second != ref.insert(k).second)
+        throw std::runtime_error("test_ranked: 1");
+    } else if (t1.erase(k) != ref.erase(k)) {
+      throw std::runtime_error("test_ranked: 2");
+    }
+    if (t1.size() != ref.size())
+      throw std::runtime_error("test_ranked: 3");
+    if (i % 500 == 0)
+      check_ranks(t1, std::vector<int>(std::begin(ref), std::end(ref)));
+  }
+  const std::vector<int> v(std::begin(ref), std::end(ref));
+  avl_height(t1);
+  check_ranks(t1, v);
+
+  set_type t2(t1);
+  check_ranks(t2, v);
+  check_ranks(set_union(set_type(), t1), v);
+
+  set_type t3;
+  t3.assign_sorted(std::begin(v), std::end(v));
+  check_ranks(t3, v);
+  if (t3.count_range(10, 10) != 0 || t3.count_range(20, 10) != 0)
+    throw std::runtime_error("test_ranked: 4");
+
+  t3.clear();
+  if (t3.size() != 0 || t3.nth(0) != t3.end() || t3.rank(1) != 0)
+    throw std::runtime_error("test_ranked: 5");
+}
+
+template <class A, class B>
+void test_hint()
+{
+  using set_type = rt::set<int, std::less<int>, A, B>;
+
+  const set_type t1 {10, 20, 30};
+  if (*t1.lower_bound(20) != 20 || *t1.lower_bound(21) != 30
+      || t1.lower_bound(5) != t1.begin() || t1.lower_bound(31) != t1.end())
+    throw std::runtime_error("test_hint: 1");
+  if (*t1.upper_bound(20) != 30 || t1.upper_bound(30) != t1.end()
+      || *t1.upper_bound(0) != 10)
+    throw std::runtime_error("test_hint: 2");
+  const auto r1 = t1.equal_range(20);
+  const auto r2 = t1.equal_range(25);
+  if (std::distance(r1.first, r1.second) != 1 || r2.first != r2.second
+      || *r2.first != 30)
+    throw std::runtime_error("test_hint: 3");
+
+  // Nearly sorted keys hinted with the position of the last one,
+  // besides wrong and repeated hints.
+  std::vector<int> v(2000);
+  std::iota(std::begin(v), std::end(v), 0);
+  for (std::size_t i = 0; i + 1 < v.size(); i += 7)
+    std::swap(v[i], v[i + 1]);
+  std::mt19937 gen;
+  std::set<int> ref;
+  set_type t2;
+  auto hint = t2.end();
+  for (auto k : v) {
+    if (gen() % 5 == 0)
+      hint = t2.find(static_cast<int>(gen() % v.size()));
+    hint = t2.insert(hint, k);
+    ref.insert(k);
+    if (*hint != k)
+      throw std::runtime_error("test_hint: 4");
+    if (*t2.insert(hint, k) != k || *t2.insert(t2.begin(), k) != k)
+      throw std::runtime_error("test_hint: 5");
+  }
+  if (t2.size() != ref.size()
+      || !std::equal(std::begin(ref), std::end(ref), std::begin(t2))
+      || !std::equal(ref.rbegin(), ref.rend(), t2.rbegin()))
+    throw std::runtime_error("test_hint: 6");
+
+  set_type t3;
+  if (!t3.emplace(5).second || t3.emplace(5).second
+      || *t3.emplace_hint(t3.end(), 7) != 7
+      || *t3.emplace_hint(t3.begin(), 5) != 5 || t3.size() != 2)
+    throw std::runtime_error("test_hint: 7");
+}
+
+// Keys emplaced in the node, without a temporary.
+void test_emplace()
+{
+  rt::set<std::string> t1;
+  auto r = t1.emplace(3, 'a');
+  if (!r.second || *r.first != "aaa" || t1.emplace("aaa").second)
+    throw std::runtime_error("test_emplace: 1");
+  auto it = t1.emplace_hint(t1.end(), 2, 'b');
+  if (*it != "bb" || *t1.emplace_hint(it, "bb") != "bb"
+      || t1.size() != 2)
+    throw std::runtime_error("test_emplace: 2");
+}
+
+template <class A, class B>
+void test_set_ops()
+{
+  using set_type = rt::set<int, std::less<int>, A, B>;
+
+  std::mt19937 gen;
+  for (int n : {0, 1, 50, 300}) {
+    std::vector<int> v1;
+    std::vector<int> v2;
+    for (int i = 0; i < n; ++i) {
+      v1.push_back(static_cast<int>(gen() % 400));
+      v2.push_back(static_cast<int>(gen() % 400));
+    }
+    const std::set<int> r1(std::begin(v1), std::end(v1));
+    const std::set<int> r2(std::begin(v2), std::end(v2));
+    std::vector<int> u;
+    std::vector<int> i;
+    std::vector<int> d;
+    std::set_union( std::begin(r1), std::end(r1), std::begin(r2)
+                  , std::end(r2), std::back_inserter(u));
+    std::set_intersection( std::begin(r1), std::end(r1), std::begin(r2)
+                         , std::end(r2), std::back_inserter(i));
+    std::set_difference( std::begin(r1), std::end(r1), std::begin(r2)
+                       , std::end(r2), std::back_inserter(d));
+
+    A alloc;
+    const set_type t1(std::begin(v1), std::end(v1), alloc);
+    const set_type t2(std::begin(v2), std::end(v2), alloc);
+    auto check = [](const set_type& t, const std::vector<int>& ref)
+    {
+      if (t.size() != ref.size()
+          || !std::equal(std::begin(ref), std::end(ref), std::begin(t))
+          || !std::equal(ref.rbegin(), ref.rend(), t.rbegin()))
+        throw std::runtime_error("test_set_ops");
+      avl_height(t);
+    };
+    check(set_union(t1, t2), u);
+    check(set_intersection(t1, t2), i);
+    check(set_difference(t1, t2), d);
+    check(set_union(t1, t1), std::vector<int>(std::begin(r1),
+                                             std::end(r1)));
+    set_type t3(t1);
+    check(set_difference(std::move(t3), t1), {});
+
+    // Between sets sharing their allocator and not.
+    set_type t4(t1);
+    set_type t5(t2);
+    t4.merge(t5);
+    check(t4, u);
+    check(t5, i);
+    set_type t6(std::begin(v1), std::end(v1));
+    set_type t7(std::begin(v2), std::end(v2));
+    t6.merge(t7);
+    t6.merge(t6);
+    check(t6, u);
+    check(t7, i);
+    t6.insert(1000);
+    t7.insert(1000);
+  }
+}
+
+void test_frozen()
+{
+  std::mt19937 gen;
+  for (int n : {0, 1, 2, 3, 7, 8, 100, 1000}) {
+    std::set<int> r;
+    while (r.size() != static_cast<std::size_t>(n))
+      r.insert(2 * static_cast<int>(gen() % 5000));
+    const std::vector<int> v(std::begin(r), std::end(r));
+    const rt::set<int, std::less<int>, std::allocator<int>
+                 , rt::tbst::avl> s(std::begin(v), std::end(v));
+    const rt::frozen_set<int> f(s);
+
+    if (f.size() != v.size() || f.empty() != v.empty()
+        || !std::equal(std::begin(v), std::end(v), std::begin(f))
+        || !std::equal(v.rbegin(), v.rend(), f.rbegin())
+        || f != rt::frozen_set<int>(std::begin(v), std::end(v)))
+      throw std::runtime_error("test_frozen: 1");
+
+    auto pos = [&](rt::frozen_set<int>::const_iterator iter)
+    { return std::distance(std::begin(f), iter); };
+
+    // Odd keys fall between the stored ones.
+    for (int key = -1; key <= 10001; ++key) {
+      const auto lb = std::lower_bound(std::begin(v), std::end(v), key);
+      const auto ub = std::upper_bound(std::begin(v), std::end(v), key);
+      const auto found = lb != std::end(v) && *lb == key;
+      if (pos(f.lower_bound(key)) != lb - std::begin(v)
+          || pos(f.upper_bound(key)) != ub - std::begin(v)
+          || f.count(key) != r.count(key)
+          || (f.find(key) != std::end(f)) != found
+          || (found && *f.find(key) != key))
+        throw std::runtime_error("test_frozen: 2");
+    }
+  }
+}
+
+// Keys the fixed size allocator of the set cannot take stay in the
+// other set.
+void test_merge_fixed()
+{
+  using Node = rt::set<int>::node_type;
+  using A = rt::node_allocator< int, Node, unsigned, 4
+                              , std::allocator<int>, rt::fixed_policy>;
+  using set_type = rt::set<int, std::less<int>, A>;
+
+  A a1;
+  A a2;
+  a1.reserve(6);
+  a2.reserve(64);
+  std::vector<int> v1 {0, 10, 20, 30};
+  std::vector<int> v2;
+  for (int i = 0; i < 20; ++i)
+    v2.push_back(2 * i + 1);
+  set_type t1(std::begin(v1), std::end(v1), a1);
+  set_type t2(std::begin(v2), std::end(v2), a2);
+  t1.merge(t2);
+
+  std::vector<int> all(std::begin(t1), std::end(t1));
+  all.insert(std::end(all), std::begin(t2), std::end(t2));
+  std::sort(std::begin(all), std::end(all));
+  v1.insert(std::end(v1), std::begin(v2), std::end(v2));
+  std::sort(std::begin(v1), std::end(v1));
+  if (t1.size() <= 4 || t2.empty() || all != v1
+      || t1.size() + t2.size() != v1.size())
+    throw std::runtime_error("test_merge_fixed: 1");
+
+  // The keys left are still usable.
+  t2.erase(*t2.begin());
+  if (t2.size() + t1.size() != v1.size() - 1)
+    throw std::runtime_error("test_merge_fixed: 2");
+}
+
 template <class A>
 void run_tests()
 {
@@ -220,6 +928,33 @@ int main()
     run_tests<A3A>();
     run_tests<A3B>();
     run_tests<A4A>();
+    test_avl<A1>();
+    test_avl<A4A>();
+    test_assign_sorted<A1>();
+    test_assign_sorted<A4A>();
+    test_assign_order();
+    using RNode =
+      rt::set< int, std::less<int>, std::allocator<int>
+             , rt::tbst::ranked>::node_type;
+    test_hint<A1, rt::tbst::unbalanced>();
+    test_hint<A4A, rt::tbst::unbalanced>();
+    test_hint<A1, rt::tbst::avl>();
+    test_hint<A4A, rt::tbst::avl>();
+    test_emplace();
+    test_set_ops<A1, rt::tbst::avl>();
+    test_set_ops<A4A, rt::tbst::avl>();
+    test_set_ops<A3B, rt::tbst::avl>();
+    test_merge_fixed();
+    test_frozen();
+    test_ranked<A1>();
+    test_ranked<rt::node_allocator<int, RNode, unsigned, 128>>();
+    test_ranked<rt::node_allocator<int, RNode, unsigned short, 4>>();
+    test_fixed();
+    test_bound();
+    test_compact();
+    test_drop_nodes();
+    test_persistent();
+    test_shared();
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
     return 1;